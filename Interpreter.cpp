@@ -5,6 +5,28 @@
 #include <fstream>
 #include <nlohmann/json.hpp> // JSON library for enhanced data parsing
 #include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <string_view>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cerrno>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CONTOUR_HAS_MMAP 1
+#else
+#define CONTOUR_HAS_MMAP 0
+#endif
 
 using json = nlohmann::json;
 
@@ -14,7 +36,37 @@ std::unordered_map<std::string, size_t> reference_table;
 std::vector<int64_t> memory(256, 0);
 size_t memory_index = 0;
 size_t program_counter = 0;
-std::vector<std::vector<int64_t>> binary_program;
+
+// Packed instruction: opcode byte plus three compact operand fields (16 bytes)
+struct Instruction {
+    uint8_t opcode;
+    uint8_t base_opcode;   // Original opcode when fused into a superinstruction, else 0
+    uint8_t reserved[2];
+    int32_t a;
+    int32_t b;
+    int32_t c;
+};
+static_assert(sizeof(Instruction) == 16, "Instruction must stay 16 bytes");
+
+// The whole program lives in one contiguous array
+std::vector<Instruction> binary_program;
+std::vector<int64_t> constant_pool;      // LET immediates, referenced by index
+std::vector<std::string> symbol_pool;    // Variable names; operands hold slots once resolved
+std::unordered_map<int64_t, int32_t> constant_index;
+std::unordered_map<std::string, int32_t> symbol_index;
+
+// The program the engines execute: either binary_program/constant_pool or the
+// pages of a mapped .ctrb image
+struct ProgramView {
+    Instruction *code = nullptr;
+    size_t size = 0;
+    int64_t *constants = nullptr;
+    size_t constant_count = 0;
+};
+ProgramView active_program;
+
+// Set once verify_binary_program() has accepted active_program; cleared on every load
+bool program_verified = false;
 
 // Load JSON data from file
 json load_json(const std::string &file_name) {
@@ -32,10 +84,142 @@ json load_json(const std::string &file_name) {
 void initialize_opcode_lookup() {
     opcode_lookup = {
         {"LET", 0x10}, {"ADD", 0x20}, {"SUBTRACT", 0x21}, {"MULTIPLY", 0x22}, {"DIVIDE", 0x23},
-        {"JUMP", 0x30}, {"IF", 0x31}, {"LOOP", 0x32}, {"PRINT", 0x40}
+        {"COMPARE", 0x24},
+        {"JUMP", 0x30}, {"IF", 0x31}, {"LOOP", 0x32}, {"LOOP_BEGIN", 0x33}, {"LOOP_END", 0x34},
+        {"SWITCH_TABLE", 0x35}, {"SWITCH_SEARCH", 0x36},
+        {"PRINT", 0x40}, {"MALLOC", 0x70}, {"FREE", 0x71}
     };
 }
 
+// Narrow a text operand into a packed 32-bit field
+int32_t narrow_operand(int64_t value) {
+    if (value < INT32_MIN || value > INT32_MAX) {
+        std::cerr << "Error: Operand out of range - " << value << std::endl;
+        exit(1);
+    }
+    return static_cast<int32_t>(value);
+}
+
+int32_t intern_constant(int64_t value) {
+    auto it = constant_index.find(value);
+    if (it != constant_index.end()) return it->second;
+    int32_t index = static_cast<int32_t>(constant_pool.size());
+    constant_pool.push_back(value);
+    constant_index[value] = index;
+    return index;
+}
+
+// Append a run of constants read by position (switch tables); never interned
+int32_t append_constants(const std::vector<int64_t> &values) {
+    int32_t index = static_cast<int32_t>(constant_pool.size());
+    constant_pool.insert(constant_pool.end(), values.begin(), values.end());
+    return index;
+}
+
+// Drop every constant from index size on, and forget the interned ones among them
+void truncate_constants(size_t size) {
+    if (constant_pool.size() <= size) return;
+    for (auto it = constant_index.begin(); it != constant_index.end();)
+        it = static_cast<size_t>(it->second) >= size ? constant_index.erase(it) : std::next(it);
+    constant_pool.resize(size);
+}
+
+int32_t intern_symbol(const std::string &name) {
+    auto it = symbol_index.find(name);
+    if (it != symbol_index.end()) return it->second;
+    int32_t index = static_cast<int32_t>(symbol_pool.size());
+    symbol_pool.push_back(name);
+    symbol_index[name] = index;
+    return index;
+}
+
+// Pack one text instruction (opcode plus three parameters) into its fixed-width form
+Instruction encode_instruction(int64_t opcode, const int64_t params[3]) {
+    Instruction instruction = {};
+    instruction.opcode = static_cast<uint8_t>(opcode);
+    switch (instruction.opcode) {
+        case 0x10: // let: name, immediate
+            instruction.a = intern_symbol(std::to_string(params[0]));
+            instruction.b = intern_constant(params[1]);
+            break;
+        case 0x20: case 0x21: case 0x22: case 0x24: // arithmetic and compare: src, src, destination name
+            instruction.a = narrow_operand(params[0]);
+            instruction.b = narrow_operand(params[1]);
+            instruction.c = intern_symbol(std::to_string(params[2]));
+            break;
+        case 0x70: // malloc: byte count, unused, destination name
+            instruction.a = intern_constant(params[0]);
+            instruction.c = intern_symbol(std::to_string(params[2]));
+            break;
+        default:
+            instruction.a = narrow_operand(params[0]);
+            instruction.b = narrow_operand(params[1]);
+            instruction.c = narrow_operand(params[2]);
+            break;
+    }
+    return instruction;
+}
+
+// Map a variable name to its fixed memory slot, assigning one on first use
+size_t resolve_variable_slot(const std::string &var) {
+    auto it = reference_table.find(var);
+    if (it != reference_table.end()) return it->second;
+    size_t slot = memory_index++;
+    if (slot >= memory.size()) {
+        std::cerr << "Error: No memory slot left for variable " << var << std::endl;
+        exit(1);
+    }
+    reference_table[var] = slot;
+    return slot;
+}
+
+// Blocks MALLOC handed out and not yet freed: the size, and the memory slot the
+// address was stored in (-1 for none), so a session snapshot can carry the heap and
+// knows which slot points at each block
+struct HeapBlock {
+    size_t size;
+    int64_t slot;
+};
+std::unordered_map<int64_t, HeapBlock> heap_blocks;
+
+int64_t vm_malloc(int64_t size, int64_t slot) {
+    void *block = std::malloc(static_cast<size_t>(size));
+    int64_t address = reinterpret_cast<int64_t>(block);
+    if (block) heap_blocks[address] = {static_cast<size_t>(size), slot};
+    return address;
+}
+
+void vm_free(int64_t address) {
+    heap_blocks.erase(address);
+    std::free(reinterpret_cast<void *>(address));
+}
+
+// Rewrite every symbolic operand into its memory slot once, at load time, so the
+// handlers only do indexed loads and stores
+void resolve_symbols() {
+    for (Instruction &instruction : binary_program) {
+        switch (instruction.opcode) {
+            case 0x10: // let
+                instruction.a = static_cast<int32_t>(resolve_variable_slot(symbol_pool[instruction.a]));
+                break;
+            case 0x20: case 0x21: case 0x22: case 0x24: case 0x70: // arithmetic, compare and malloc destination
+                instruction.c = static_cast<int32_t>(resolve_variable_slot(symbol_pool[instruction.c]));
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Point the engines at the text-loaded program
+void bind_program_view() {
+    active_program.code = binary_program.data();
+    active_program.size = binary_program.size();
+    active_program.constants = constant_pool.data();
+    active_program.constant_count = constant_pool.size();
+    program_verified = false;
+}
+
 // Load binary instructions dynamically from a file
 void load_binary_program(const std::string &file_name) {
     std::ifstream file(file_name);
@@ -46,17 +230,362 @@ void load_binary_program(const std::string &file_name) {
 
     int64_t opcode;
     while (file >> opcode) {
-        std::vector<int64_t> instruction;
-        instruction.push_back(opcode);
-
         // Assume each instruction has fixed parameters for simplicity
+        int64_t params[3] = {0, 0, 0};
         for (int i = 0; i < 3; ++i) {
-            int64_t param;
-            file >> param;
-            instruction.push_back(param);
+            file >> params[i];
         }
-        binary_program.push_back(instruction);
+        binary_program.push_back(encode_instruction(opcode, params));
+    }
+    resolve_symbols();
+    bind_program_view();
+}
+
+// .ctrb binary container. Sections are 16-byte aligned and stored in host byte order:
+//   CtrbHeader | Instruction[instruction_count] | int64_t[constant_count]
+//   | CtrbSymbol[symbol_count] | symbol name bytes
+// Operands are stored already resolved to memory slots, so a mapped image runs as-is.
+const char CTRB_MAGIC[4] = {'C', 'T', 'R', 'B'};
+const uint16_t CTRB_VERSION = 1;
+const uint32_t CTRB_BYTE_ORDER = 0x01020304;
+
+struct CtrbHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t instruction_size;
+    uint32_t byte_order;
+    uint32_t instruction_count;
+    uint32_t constant_count;
+    uint32_t symbol_count;
+    uint64_t instruction_offset;
+    uint64_t constant_offset;
+    uint64_t symbol_offset;
+    uint64_t string_offset;
+    uint64_t string_size;
+};
+
+struct CtrbSymbol {
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t slot;
+    uint32_t reserved;
+};
+
+// Keeps a loaded .ctrb image alive while active_program points into it
+struct MappedImage {
+    void *base = nullptr;
+    size_t length = 0;
+#if !CONTOUR_HAS_MMAP
+    std::vector<char> buffer;   // Fallback when mmap is unavailable
+#endif
+};
+MappedImage mapped_image;
+
+uint64_t align_section(uint64_t offset) {
+    return (offset + 15) & ~uint64_t(15);
+}
+
+// Write the loaded program as a .ctrb image; false when the file cannot be written
+bool save_ctrb_image(const std::string &file_name) {
+    std::vector<std::pair<std::string, size_t>> symbols(reference_table.begin(), reference_table.end());
+    std::string names;
+    std::vector<CtrbSymbol> symbol_records;
+    for (const auto &symbol : symbols) {
+        CtrbSymbol record = {};
+        record.name_offset = static_cast<uint32_t>(names.size());
+        record.name_length = static_cast<uint32_t>(symbol.first.size());
+        record.slot = static_cast<uint32_t>(symbol.second);
+        symbol_records.push_back(record);
+        names += symbol.first;
+    }
+
+    CtrbHeader header = {};
+    std::memcpy(header.magic, CTRB_MAGIC, sizeof(CTRB_MAGIC));
+    header.version = CTRB_VERSION;
+    header.instruction_size = sizeof(Instruction);
+    header.byte_order = CTRB_BYTE_ORDER;
+    header.instruction_count = static_cast<uint32_t>(active_program.size);
+    header.constant_count = static_cast<uint32_t>(active_program.constant_count);
+    header.symbol_count = static_cast<uint32_t>(symbol_records.size());
+    header.instruction_offset = align_section(sizeof(CtrbHeader));
+    header.constant_offset = align_section(header.instruction_offset + active_program.size * sizeof(Instruction));
+    header.symbol_offset = align_section(header.constant_offset + active_program.constant_count * sizeof(int64_t));
+    header.string_offset = align_section(header.symbol_offset + symbol_records.size() * sizeof(CtrbSymbol));
+    header.string_size = names.size();
+
+    std::vector<char> image(header.string_offset + names.size(), 0);
+    std::memcpy(image.data(), &header, sizeof(header));
+    if (active_program.size)
+        std::memcpy(image.data() + header.instruction_offset, active_program.code, active_program.size * sizeof(Instruction));
+    if (active_program.constant_count)
+        std::memcpy(image.data() + header.constant_offset, active_program.constants, active_program.constant_count * sizeof(int64_t));
+    if (!symbol_records.empty())
+        std::memcpy(image.data() + header.symbol_offset, symbol_records.data(), symbol_records.size() * sizeof(CtrbSymbol));
+    std::memcpy(image.data() + header.string_offset, names.data(), names.size());
+
+    std::ofstream out(file_name, std::ios::binary);
+    out.write(image.data(), static_cast<std::streamsize>(image.size()));
+    return static_cast<bool>(out);
+}
+
+void write_ctrb_image(const std::string &file_name) {
+    if (!save_ctrb_image(file_name)) {
+        std::cerr << "Error: Could not write " << file_name << std::endl;
+        exit(1);
+    }
+}
+
+// Offline converter from the whitespace text format to .ctrb
+void convert_text_to_ctrb(const std::string &text_file, const std::string &ctrb_file) {
+    load_binary_program(text_file);
+    write_ctrb_image(ctrb_file);
+}
+
+void unload_ctrb_image() {
+#if CONTOUR_HAS_MMAP
+    if (mapped_image.base) munmap(mapped_image.base, mapped_image.length);
+#else
+    mapped_image.buffer.clear();
+#endif
+    mapped_image.base = nullptr;
+    mapped_image.length = 0;
+}
+
+// FNV-1a over a byte range; chain calls by passing the previous hash
+uint64_t hash_bytes(const void *data, size_t size, uint64_t hash = 14695981039346656037ull) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Map a .ctrb image and execute straight from its pages. The mapping is private, so
+// later rewriting passes only copy the pages they touch. On failure nothing is loaded
+// and problem says why; with expected_hash the image bytes must also hash to it.
+bool map_ctrb_image(const std::string &file_name, std::string &problem, const uint64_t *expected_hash = nullptr) {
+    unload_ctrb_image();
+#if CONTOUR_HAS_MMAP
+    int fd = open(file_name.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        if (fd >= 0) close(fd);
+        problem = "Could not open binary program file.";
+        return false;
+    }
+    mapped_image.length = static_cast<size_t>(info.st_size);
+    void *base = mapped_image.length ? mmap(nullptr, mapped_image.length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+                                     : MAP_FAILED;
+    close(fd);
+    if (base == MAP_FAILED) {
+        mapped_image.length = 0;
+        problem = "Could not map " + file_name;
+        return false;
+    }
+    mapped_image.base = base;
+#else
+    std::ifstream file(file_name, std::ios::binary);
+    if (!file) {
+        problem = "Could not open binary program file.";
+        return false;
+    }
+    mapped_image.buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    mapped_image.base = mapped_image.buffer.data();
+    mapped_image.length = mapped_image.buffer.size();
+#endif
+
+    char *bytes = static_cast<char *>(mapped_image.base);
+    const CtrbHeader *header = reinterpret_cast<const CtrbHeader *>(bytes);
+    auto section_fits = [&](uint64_t offset, uint64_t count, uint64_t size) {
+        return offset <= mapped_image.length && count <= (mapped_image.length - offset) / size;
+    };
+    if (expected_hash && hash_bytes(bytes, mapped_image.length) != *expected_hash) {
+        unload_ctrb_image();
+        problem = file_name + " does not match its recorded hash.";
+        return false;
+    }
+    if (mapped_image.length < sizeof(CtrbHeader) || std::memcmp(header->magic, CTRB_MAGIC, sizeof(CTRB_MAGIC)) != 0 ||
+        header->version != CTRB_VERSION || header->instruction_size != sizeof(Instruction) ||
+        header->byte_order != CTRB_BYTE_ORDER ||
+        !section_fits(header->instruction_offset, header->instruction_count, sizeof(Instruction)) ||
+        !section_fits(header->constant_offset, header->constant_count, sizeof(int64_t)) ||
+        !section_fits(header->symbol_offset, header->symbol_count, sizeof(CtrbSymbol)) ||
+        !section_fits(header->string_offset, header->string_size, 1) ||
+        header->instruction_offset % 16 || header->constant_offset % 16 || header->symbol_offset % 16) {
+        unload_ctrb_image();
+        problem = file_name + " is not a valid .ctrb image.";
+        return false;
+    }
+    const CtrbSymbol *symbols = reinterpret_cast<const CtrbSymbol *>(bytes + header->symbol_offset);
+    for (uint32_t i = 0; i < header->symbol_count; ++i) {
+        if (symbols[i].name_offset > header->string_size ||
+            symbols[i].name_length > header->string_size - symbols[i].name_offset) {
+            unload_ctrb_image();
+            problem = file_name + " has a corrupt symbol table.";
+            return false;
+        }
+    }
+
+    active_program.code = reinterpret_cast<Instruction *>(bytes + header->instruction_offset);
+    active_program.size = header->instruction_count;
+    active_program.constants = reinterpret_cast<int64_t *>(bytes + header->constant_offset);
+    active_program.constant_count = header->constant_count;
+    program_verified = false;
+
+    // Only the symbol table is copied out, so later names get fresh slots
+    const char *names = bytes + header->string_offset;
+    for (uint32_t i = 0; i < header->symbol_count; ++i) {
+        std::string name(names + symbols[i].name_offset, symbols[i].name_length);
+        reference_table[name] = symbols[i].slot;
+        memory_index = std::max(memory_index, static_cast<size_t>(symbols[i].slot) + 1);
+        intern_symbol(name);
+    }
+    if (memory.size() < memory_index) memory.resize(memory_index, 0);   // Compiled sources may need more
+    return true;
+}
+
+void load_ctrb_image(const std::string &file_name) {
+    std::string problem;
+    if (!map_ctrb_image(file_name, problem)) {
+        std::cerr << "Error: " << problem << std::endl;
+        exit(1);
+    }
+}
+
+// Source files a compiled program was built from, with their content hashes
+using SourceHashes = std::vector<std::pair<std::string, uint64_t>>;
+
+SourceHashes compile_contour_program(const std::vector<std::string> &files);
+
+// Compiled-program cache. A text or .ctr program is stored, compiled, as <key>.ctrb under
+// the cache directory, next to <key>.deps which records the image hash and the hash of
+// every source file it was built from. The key covers the compiler and image versions,
+// the path and the file contents. A warm start rehashes the listed sources and maps the
+// image without parsing anything; any mismatch recompiles and replaces the entry.
+// Fusion, dispatch and the JIT are applied after loading, so they are not part of the key.
+const uint32_t CONTOUR_COMPILER_VERSION = 2;   // Bump whenever generated code changes
+
+// The cache is opt-in: CONTOUR_CACHE=1 enables it, CONTOUR_CACHE_DIR overrides its location.
+// A cache that cannot be written is skipped without a message; the run goes on regardless.
+bool cache_enabled = false;
+std::string cache_directory;
+
+void configure_cache_from_env() {
+    const char *mode = std::getenv("CONTOUR_CACHE");
+    cache_enabled = CONTOUR_HAS_MMAP && mode && std::string(mode) == "1";   // Entries need mkdir and rename
+    if (const char *directory = std::getenv("CONTOUR_CACHE_DIR")) cache_directory = directory;
+    else if (const char *xdg = std::getenv("XDG_CACHE_HOME")) cache_directory = std::string(xdg) + "/contour";
+    else if (const char *home = std::getenv("HOME")) cache_directory = std::string(home) + "/.cache/contour";
+    if (cache_directory.empty()) cache_enabled = false;
+}
+
+bool hash_file(const std::string &path, uint64_t &hash) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    hash = hash_bytes(contents.data(), contents.size());
+    return true;
+}
+
+std::string cache_key(const std::string &file_name, uint64_t content_hash) {
+    uint64_t hash = hash_bytes(&CONTOUR_COMPILER_VERSION, sizeof(CONTOUR_COMPILER_VERSION));
+    hash = hash_bytes(&CTRB_VERSION, sizeof(CTRB_VERSION), hash);
+    hash = hash_bytes(&CTRB_BYTE_ORDER, sizeof(CTRB_BYTE_ORDER), hash);
+    hash = hash_bytes(file_name.data(), file_name.size() + 1, hash);
+    hash = hash_bytes(&content_hash, sizeof(content_hash), hash);
+    char key[17];
+    std::snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(hash));
+    return key;
+}
+
+// Map the cached image for key if it and every source it lists are unchanged
+bool load_cached_program(const std::string &key) {
+    std::ifstream deps(cache_directory + "/" + key + ".deps");
+    std::string tag;
+    uint32_t version = 0;
+    uint64_t image_hash = 0;
+    if (!(deps >> tag >> version) || tag != "contour-cache" || version != CONTOUR_COMPILER_VERSION) return false;
+    if (!(deps >> tag >> std::hex >> image_hash) || tag != "image") return false;
+    uint64_t recorded, current;
+    while (deps >> tag >> std::hex >> recorded) {
+        std::string path;
+        std::getline(deps, path);
+        if (tag != "source" || path.size() < 2 || !hash_file(path.substr(1), current) || current != recorded) return false;
+    }
+    std::string problem;
+    return map_ctrb_image(cache_directory + "/" + key + ".ctrb", problem, &image_hash);
+}
+
+#if CONTOUR_HAS_MMAP
+// mkdir -p; false when the directory still does not exist
+bool make_directories(const std::string &path) {
+    for (size_t slash = path.find('/', 1);; slash = path.find('/', slash + 1)) {
+        if (mkdir(path.substr(0, slash).c_str(), 0755) != 0 && errno != EEXIST) return false;
+        if (slash == std::string::npos) return true;
+    }
+}
+
+// Save the loaded program under key. Files are written under temporary names and renamed
+// into place, so a concurrent reader sees either entry whole; a deps file paired with
+// another run's image fails the image hash check and is only a miss.
+void store_cached_program(const std::string &key, const SourceHashes &sources) {
+    if (!make_directories(cache_directory)) return;
+    const std::string entry = cache_directory + "/" + key;
+    const std::string temporary = entry + "." + std::to_string(getpid());
+    uint64_t image_hash;
+    if (!save_ctrb_image(temporary + ".ctrb") || !hash_file(temporary + ".ctrb", image_hash)) {
+        std::remove((temporary + ".ctrb").c_str());
+        return;
     }
+    {
+        std::ofstream deps(temporary + ".deps");
+        deps << "contour-cache " << CONTOUR_COMPILER_VERSION << "\n" << std::hex << "image " << image_hash << "\n";
+        for (const auto &source : sources) deps << "source " << source.second << " " << source.first << "\n";
+        if (!deps) {
+            std::remove((temporary + ".deps").c_str());
+            std::remove((temporary + ".ctrb").c_str());
+            return;
+        }
+    }
+    if (std::rename((temporary + ".ctrb").c_str(), (entry + ".ctrb").c_str()) != 0) {
+        std::remove((temporary + ".deps").c_str());
+        std::remove((temporary + ".ctrb").c_str());
+        return;
+    }
+    if (std::rename((temporary + ".deps").c_str(), (entry + ".deps").c_str()) != 0)
+        std::remove((temporary + ".deps").c_str());
+}
+#else
+void store_cached_program(const std::string &, const SourceHashes &) {}
+#endif
+
+
+// Pick the loader by extension: .ctrb images are mapped, .ctr source is compiled and
+// anything else is parsed as text
+void load_program_file(const std::string &file_name) {
+    auto has_extension = [&](const std::string &extension) {
+        return file_name.size() >= extension.size() &&
+               file_name.compare(file_name.size() - extension.size(), extension.size(), extension) == 0;
+    };
+    if (has_extension(".ctrb")) {
+        load_ctrb_image(file_name);
+        return;
+    }
+    std::string key;
+    uint64_t content_hash = 0;
+    if (cache_enabled && hash_file(file_name, content_hash)) {
+        key = cache_key(file_name, content_hash);
+        if (load_cached_program(key)) return;
+    }
+    SourceHashes sources;
+    if (has_extension(".ctr")) {
+        sources = compile_contour_program({file_name});
+    } else {
+        load_binary_program(file_name);
+        sources.push_back({file_name, content_hash});
+    }
+    if (!key.empty()) store_cached_program(key, sources);
 }
 
 // Error handling: Ensure valid opcode and memory bounds
@@ -83,313 +612,4932 @@ void allocate_variable(const std::string &var, int64_t value) {
     memory[reference_table[var]] = value;
 }
 
-// Execute the binary program with control structures
-void execute_binary_program() {
-    while (program_counter < binary_program.size()) {
-        const std::vector<int64_t> &instruction = binary_program[program_counter];
-        uint8_t opcode = instruction[0];
+// Superinstructions: a fused opcode replaces the first instruction of a pair and its
+// handler also executes the second one, reading that one's operands in place. The second
+// instruction is left untouched, so jumps that land on it still work.
+struct FusionRule {
+    uint8_t first;
+    uint8_t second;
+    uint8_t fused;
+    const char *name;
+};
 
-        switch (opcode) {
-            case 0x10: // let
-                allocate_variable(reinterpret_cast<char *>(instruction[1]), instruction[2]);
-                break;
-            case 0x20: // add
-                allocate_variable(reinterpret_cast<char *>(instruction[3]),
-                                  memory[instruction[1]] + memory[instruction[2]]);
-                break;
-            case 0x21: // subtract
-                allocate_variable(reinterpret_cast<char *>(instruction[3]),
-                                  memory[instruction[1]] - memory[instruction[2]]);
-                break;
-            case 0x22: // multiply
-                allocate_variable(reinterpret_cast<char *>(instruction[3]),
-                                  memory[instruction[1]] * memory[instruction[2]]);
-                break;
-            case 0x30: // jmp
-                program_counter = instruction[1] - 1; // Jump to the specified address
-                break;
-            case 0x31: // if
-                if (memory[instruction[1]] != 0) {
-                    program_counter = instruction[2] - 1; // Conditional jump
-                }
-                break;
-            case 0x32: // loop
-                for (int i = 0; i < memory[instruction[1]]; ++i) {
-                    program_counter = instruction[2] - 1; // Loop to address
-                }
-                break;
-            case 0x40: // print
-                check_memory_bounds(instruction[1]);
-                std::cout << "Value: " << memory[instruction[1]] << std::endl;
-                break;
-            default:
-                std::cerr << "Unknown opcode: 0x" << std::hex << (int)opcode << std::endl;
-                exit(1);
-        }
-        program_counter++;
+const FusionRule fusion_rules[] = {
+    {0x10, 0x10, 0xA0, "LET+LET"},
+    {0x10, 0x20, 0xA1, "LET+ADD"},
+    {0x20, 0x30, 0xA2, "ADD+JUMP"},
+    {0x21, 0x30, 0xA3, "SUBTRACT+JUMP"},
+    {0x22, 0x30, 0xA4, "MULTIPLY+JUMP"},
+    {0x20, 0x31, 0xA5, "ADD+IF"},
+    {0x21, 0x31, 0xA6, "SUBTRACT+IF"},
+};
+
+bool is_fused_opcode(uint8_t opcode) {
+    return opcode >= 0xA0 && opcode <= 0xA6;
+}
+
+uint8_t base_opcode_of(const Instruction &instruction) {
+    return is_fused_opcode(instruction.opcode) ? instruction.base_opcode : instruction.opcode;
+}
+
+const FusionRule *find_fusion_rule(uint8_t first, uint8_t second) {
+    for (const FusionRule &rule : fusion_rules) {
+        if (rule.first == first && rule.second == second) return &rule;
     }
+    return nullptr;
 }
 
-// AST Interpreter with loop and condition nodes
-class AOTInterpreter {
-private:
-    struct Node {
-        std::string command;
-        Node *left;
-        Node *right;
-    };
+// Counted loops: LOOP_BEGIN (0x33) count_slot, end_pc and LOOP_END (0x34) begin_pc. The
+// engines keep the innermost trip counter in a local, the outer ones in a fixed array.
+const size_t MAX_LOOP_DEPTH = 64;
+
+// Multiway branches: SWITCH_TABLE (0x35) slot, table and SWITCH_SEARCH (0x36) slot, table,
+// with the table in the constant pool. A dense table is min, count, default target and
+// count targets indexed by value - min; a search table is count, default target, count
+// sorted keys and then their targets.
+bool switch_values_are_dense(int64_t min, int64_t max, size_t count) {
+    uint64_t span = static_cast<uint64_t>(max) - static_cast<uint64_t>(min);
+    return span < 4 * count + 8 && span < (1u << 16);
+}
 
-    std::vector<Node *> garbageCollection;
+// Arithmetic wraps in two's complement in every engine, as the JIT's native add, sub and
+// imul do; the casts keep signed overflow out of the C++ handlers
+inline int64_t wrapping_add(int64_t a, int64_t b) {
+    return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+}
 
-    Node *create_node(const std::string &command) {
-        Node *node = new Node();
-        node->command = command;
-        node->left = nullptr;
-        node->right = nullptr;
-        return node;
-    }
+inline int64_t wrapping_subtract(int64_t a, int64_t b) {
+    return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b));
+}
 
-    void execute_tree(Node *root) {
-        if (!root) return;
+inline int64_t wrapping_multiply(int64_t a, int64_t b) {
+    return static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+}
 
-        if (root->command == "IF") {
-            std::cout << "Evaluating IF condition\n";
-            execute_tree(root->left);  // Evaluate left child as condition
-            if (rand() % 2) execute_tree(root->right);  // Simulate condition outcome
-        } else if (root->command == "LOOP") {
-            std::cout << "Executing LOOP block\n";
-            for (int i = 0; i < 3; ++i) execute_tree(root->left);  // Simulate a loop
-        } else {
-            std::cout << "Executing: " << root->command << std::endl;
-        }
+// COMPARE: -1, 0 or 1 as a is below, equal to or above b, with no subtraction to overflow
+inline int64_t compare_values(int64_t a, int64_t b) {
+    return (a > b) - (a < b);
+}
 
-        garbageCollection.push_back(root);
-    }
+inline size_t switch_table_target(const int64_t *table, int64_t value) {
+    uint64_t index = static_cast<uint64_t>(value) - static_cast<uint64_t>(table[0]);
+    return static_cast<size_t>(index < static_cast<uint64_t>(table[1]) ? table[3 + index] : table[2]);
+}
 
-    void clean_up() {
-        for (Node *node : garbageCollection) {
-            delete node;
-        }
-        garbageCollection.clear();
-    }
+inline size_t switch_search_target(const int64_t *table, int64_t value) {
+    const int64_t count = table[0];
+    const int64_t *keys = table + 2;
+    const int64_t *found = std::lower_bound(keys, keys + count, value);
+    return static_cast<size_t>(found != keys + count && *found == value ? keys[count + (found - keys)] : table[1]);
+}
 
-public:
-    void run() {
-        Node *root = create_node("IF");
-        root->left = create_node("Condition");
-        root->right = create_node("LOOP");
-        root->right->left = create_node("Loop Body");
+// Contour source front end. Compiles .ctr modules straight to the packed bytecode:
+//   import m;   let x: Integer = e;   const c: Integer = e;   x = e;   print(e);
+//   def f(a: Integer) -> Integer { ...; return e; }   if e { } else { }   while e { }
+//   for i in a..b { } (a..=b is inclusive)   match e { case 1 -> s; case _ -> { ... } }
+// Every value is a 64-bit integer (Integer or Bool). The bytecode has no call instruction,
+// so calls are expanded inline and recursion is rejected. Modules are parsed and compiled
+// into module-local code on a pool of threads, then linked in import order.
+enum class SourceTokenKind : uint8_t { Identifier, Number, String, Symbol, End };
+
+struct SourceToken {
+    SourceTokenKind kind;
+    std::string_view text;
+    int line;
+    int64_t value;   // Number
+};
 
-        execute_tree(root);
-        clean_up();
-    }
+// Thrown while parsing or compiling one module; the driver reports it once all workers finish
+struct SourceError {
+    std::string path;
+    int line;
+    std::string message;
 };
 
-// REPL Implementation
-void repl() {
-    std::string input;
-    std::cout << "REPL Mode - Type 'exit' to quit.\n";
-    while (true) {
-        std::cout << ">> ";
-        std::getline(std::cin, input);
-        if (input == "exit") break;
+struct SourceExpr {
+    enum Kind : uint8_t { Number, Name, Call, Unary, Binary } kind;
+    int line;
+    int64_t value = 0;               // Number
+    std::string_view qualifier;      // Module of a qualified name or call (m.x, m.f())
+    std::string_view text;           // Name, callee or operator
+    std::vector<std::unique_ptr<SourceExpr>> operands;   // Arguments or operands
+};
 
-        std::istringstream iss(input);
-        std::string command;
-        int64_t operand1, operand2;
-        iss >> command >> operand1 >> operand2;
+struct SourceStmt;
+using SourceBlock = std::vector<std::unique_ptr<SourceStmt>>;
+
+struct SourceArm {
+    bool wildcard;
+    int64_t key;
+    SourceBlock body;
+};
+
+struct SourceStmt {
+    enum Kind : uint8_t { Let, Assign, Print, If, While, For, Match, Return, Evaluate } kind;
+    int line;
+    std::string_view name;                  // Let, Assign and For variable
+    bool constant = false;                  // const declaration
+    bool inclusive = false;                 // for over a..=b
+    std::unique_ptr<SourceExpr> value;      // Initializer, condition, range start, subject or result
+    std::unique_ptr<SourceExpr> limit;      // Range end
+    SourceBlock body;
+    SourceBlock alternative;                // else branch; else-if is a nested If
+    std::vector<SourceArm> arms;            // match
+};
 
-        if (opcode_lookup.find(command) != opcode_lookup.end()) {
-            std::cout << "Command: " << command << " executed with operands: "
-                      << operand1 << ", " << operand2 << "\n";
+struct SourceFunction {
+    std::string_view name;
+    std::vector<std::string_view> params;
+    SourceBlock body;
+    int line;
+};
+
+// Output of one module before linking. Slots are indices into slot_names, LET operands
+// index constants, switch operands index tables and jump targets are module-local pcs.
+struct CompiledTable {
+    bool dense;
+    std::vector<int64_t> values;
+};
+
+struct CompiledModule {
+    std::vector<Instruction> code;
+    std::vector<int64_t> constants;
+    std::vector<CompiledTable> tables;
+    std::vector<std::string> slot_names;   // Linked by name, so modules share globals
+};
+
+struct SourceModule {
+    std::string name;    // File stem, used by import
+    std::string path;
+    std::string text;    // Tokens and the AST point into it
+    uint64_t content_hash = 0;
+    std::vector<std::pair<std::string_view, int>> imports;   // Module name, line
+    std::vector<const SourceModule *> imported;
+    std::string import_site;   // file:line of the first import, for a missing file
+    std::unordered_map<std::string_view, SourceFunction> functions;
+    std::unordered_map<std::string_view, bool> globals;      // Top-level let/const -> is const
+    SourceBlock statements;
+    std::string error;
+    CompiledModule code;
+};
+
+std::vector<SourceToken> lex_contour_source(const SourceModule &module) {
+    static const std::string_view symbols[] = {"..=", "..", "->", "==", "!=", "<=", ">=", "&&", "||"};
+    const std::string_view text = module.text;
+    std::vector<SourceToken> tokens;
+    int line = 1;
+    size_t i = 0;
+    auto is_word = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+    while (i < text.size()) {
+        const char c = text[i];
+        if (c == '\n') line++;
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            i++;
+            continue;
+        }
+        if (c == '#' || text.compare(i, 2, "//") == 0) {   // Comment to end of line
+            while (i < text.size() && text[i] != '\n') i++;
+            continue;
+        }
+        const size_t start = i;
+        SourceToken token = {SourceTokenKind::Symbol, {}, line, 0};
+        if (std::isdigit(static_cast<unsigned char>(c))) {
+            while (i < text.size() && std::isdigit(static_cast<unsigned char>(text[i]))) i++;
+            token.kind = SourceTokenKind::Number;
+            if (std::from_chars(text.data() + start, text.data() + i, token.value).ec != std::errc())
+                throw SourceError{module.path, line, "integer literal out of range"};
+        } else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            while (i < text.size() && is_word(text[i])) i++;
+            token.kind = SourceTokenKind::Identifier;
+        } else if (c == '"') {
+            for (i++; i < text.size() && text[i] != '"' && text[i] != '\n'; i++) {
+                if (text[i] == '\\') i++;
+            }
+            if (i >= text.size() || text[i] != '"') throw SourceError{module.path, line, "unterminated string"};
+            i++;
+            token.kind = SourceTokenKind::String;
         } else {
-            std::cerr << "Unknown command: " << command << std::endl;
+            for (std::string_view symbol : symbols) {
+                if (text.compare(i, symbol.size(), symbol) == 0) {
+                    i += symbol.size();
+                    break;
+                }
+            }
+            if (i == start) {
+                if (std::strchr("{}()[];:,.=+-*/%<>!", c) == nullptr)
+                    throw SourceError{module.path, line, std::string("unexpected character '") + c + "'"};
+                i++;
+            }
         }
+        token.text = text.substr(start, i - start);
+        tokens.push_back(token);
     }
+    tokens.push_back({SourceTokenKind::End, {}, line, 0});
+    return tokens;
 }
 
-int main() {
-    initialize_opcode_lookup();
-    repl();
+// Recursive-descent parser for one module. Operators bind as || < && < equality <
+// comparison < + - < * / % < unary ! -.
+class SourceParser {
+public:
+    explicit SourceParser(SourceModule &module) : module(module), tokens(lex_contour_source(module)) {}
+
+    void parse_module() {
+        while (!at_end()) {
+            if (accept("import")) {
+                const int line = peek().line;
+                module.imports.push_back({identifier(), line});
+                expect(";");
+            } else if (check("def")) {
+                function();
+            } else {
+                module.statements.push_back(statement());
+                const SourceStmt &parsed = *module.statements.back();
+                if (parsed.kind == SourceStmt::Let) module.globals[parsed.name] = parsed.constant;
+            }
+        }
+    }
 
-    std::cout << "\nExecuting expanded AST interpreter:\n";
-    AOTInterpreter interpreter;
-    interpreter.run();
+private:
+    SourceModule &module;
+    std::vector<SourceToken> tokens;
+    size_t position = 0;
 
-    return 0;
-}
+    const SourceToken &peek(size_t ahead = 0) const {
+        return tokens[std::min(position + ahead, tokens.size() - 1)];
+    }
+    bool at_end() const { return peek().kind == SourceTokenKind::End; }
+    bool check(std::string_view text) const {
+        return peek().kind != SourceTokenKind::String && peek().kind != SourceTokenKind::End && peek().text == text;
+    }
+    bool accept(std::string_view text) {
+        if (!check(text)) return false;
+        position++;
+        return true;
+    }
 
-#include <iostream>
-#include <unordered_map>
-#include <vector>
-#include <string>
-#include <stack>
+    [[noreturn]] void fail(const std::string &message) const {
+        const SourceToken &token = peek();
+        throw SourceError{module.path, token.line,
+                          message + (token.kind == SourceTokenKind::End ? " at end of file"
+                                                                        : " near '" + std::string(token.text) + "'")};
+    }
+
+    void expect(std::string_view text) {
+        if (!accept(text)) fail("expected '" + std::string(text) + "'");
+    }
+
+    std::string_view identifier() {
+        if (peek().kind != SourceTokenKind::Identifier) fail("expected a name");
+        return tokens[position++].text;
+    }
+
+    // Type annotations are checked, not stored: the VM only has 64-bit integers
+    void type() {
+        std::string_view name = identifier();
+        if (name != "Integer" && name != "Int" && name != "Bool" && name != "Boolean") {
+            position--;
+            fail("type '" + std::string(name) + "' is not supported; the bytecode VM stores 64-bit integers only");
+        }
+    }
+
+    void function() {
+        const int line = peek().line;
+        expect("def");
+        SourceFunction function;
+        function.name = identifier();
+        function.line = line;
+        expect("(");
+        while (!check(")")) {
+            function.params.push_back(identifier());
+            if (accept(":")) type();
+            if (!check(")")) expect(",");
+        }
+        expect(")");
+        if (accept("->")) type();
+        function.body = block();
+        const std::string_view name = function.name;
+        if (!module.functions.emplace(name, std::move(function)).second)
+            throw SourceError{module.path, line, "function '" + std::string(name) + "' is defined twice"};
+    }
+
+    SourceBlock block() {
+        SourceBlock body;
+        expect("{");
+        while (!accept("}")) {
+            if (at_end()) fail("expected '}'");
+            body.push_back(statement());
+        }
+        return body;
+    }
+
+    std::unique_ptr<SourceStmt> make_statement(SourceStmt::Kind kind) {
+        auto stmt = std::make_unique<SourceStmt>();
+        stmt->kind = kind;
+        stmt->line = peek().line;
+        return stmt;
+    }
+
+    std::unique_ptr<SourceStmt> statement() {
+        if (check("let") || check("const")) {
+            auto stmt = make_statement(SourceStmt::Let);
+            stmt->constant = tokens[position++].text == "const";
+            stmt->name = identifier();
+            if (accept(":")) type();
+            expect("=");
+            stmt->value = expression();
+            expect(";");
+            return stmt;
+        }
+        if (check("print") && peek(1).text == "(") {
+            auto stmt = make_statement(SourceStmt::Print);
+            position += 2;
+            stmt->value = expression();
+            expect(")");
+            expect(";");
+            return stmt;
+        }
+        if (check("if")) {
+            auto stmt = make_statement(SourceStmt::If);
+            position++;
+            stmt->value = expression();
+            stmt->body = block();
+            if (accept("else")) {
+                if (check("if")) stmt->alternative.push_back(statement());
+                else stmt->alternative = block();
+            }
+            return stmt;
+        }
+        if (check("while")) {
+            auto stmt = make_statement(SourceStmt::While);
+            position++;
+            stmt->value = expression();
+            stmt->body = block();
+            return stmt;
+        }
+        if (check("for")) {
+            auto stmt = make_statement(SourceStmt::For);
+            position++;
+            stmt->name = identifier();
+            expect("in");
+            stmt->value = expression();
+            if (accept("..=")) stmt->inclusive = true;
+            else if (!accept("..")) fail("only integer ranges (a..b) can be iterated");
+            stmt->limit = expression();
+            stmt->body = block();
+            return stmt;
+        }
+        if (check("match")) {
+            auto stmt = make_statement(SourceStmt::Match);
+            position++;
+            stmt->value = expression();
+            expect("{");
+            while (!accept("}")) {
+                expect("case");
+                SourceArm arm = {false, 0, {}};
+                if (accept("_")) {
+                    arm.wildcard = true;
+                } else {
+                    const bool negative = accept("-");
+                    if (peek().kind != SourceTokenKind::Number) fail("expected an integer or '_'");
+                    arm.key = negative ? -tokens[position++].value : tokens[position++].value;
+                }
+                expect("->");
+                if (check("{")) arm.body = block();
+                else arm.body.push_back(statement());
+                stmt->arms.push_back(std::move(arm));
+            }
+            return stmt;
+        }
+        if (check("return")) {
+            auto stmt = make_statement(SourceStmt::Return);
+            position++;
+            if (!check(";")) stmt->value = expression();
+            expect(";");
+            return stmt;
+        }
+        if (check("import") || check("def")) fail("'" + std::string(peek().text) + "' is only allowed at the top level");
+        if (peek().kind == SourceTokenKind::Identifier && peek(1).text == "=") {
+            auto stmt = make_statement(SourceStmt::Assign);
+            stmt->name = identifier();
+            position++;
+            stmt->value = expression();
+            expect(";");
+            return stmt;
+        }
+        auto stmt = make_statement(SourceStmt::Evaluate);
+        stmt->value = expression();
+        expect(";");
+        return stmt;
+    }
+
+    static int precedence(const SourceToken &token) {
+        static const std::pair<std::string_view, int> operators[] = {
+            {"||", 1}, {"&&", 2}, {"==", 3}, {"!=", 3}, {"<", 4}, {"<=", 4}, {">", 4}, {">=", 4},
+            {"+", 5}, {"-", 5}, {"*", 6}, {"/", 6}, {"%", 6}};
+        if (token.kind != SourceTokenKind::Symbol) return 0;
+        for (const auto &entry : operators) {
+            if (entry.first == token.text) return entry.second;
+        }
+        return 0;
+    }
+
+    std::unique_ptr<SourceExpr> make_expression(SourceExpr::Kind kind, int line) {
+        auto expr = std::make_unique<SourceExpr>();
+        expr->kind = kind;
+        expr->line = line;
+        return expr;
+    }
+
+    std::unique_ptr<SourceExpr> expression(int min_precedence = 1) {
+        auto left = unary();
+        for (int level = precedence(peek()); level >= min_precedence; level = precedence(peek())) {
+            auto expr = make_expression(SourceExpr::Binary, peek().line);
+            expr->text = tokens[position++].text;
+            expr->operands.push_back(std::move(left));
+            expr->operands.push_back(expression(level + 1));
+            left = std::move(expr);
+        }
+        return left;
+    }
+
+    std::unique_ptr<SourceExpr> unary() {
+        if (check("-") || check("!")) {
+            auto expr = make_expression(SourceExpr::Unary, peek().line);
+            expr->text = tokens[position++].text;
+            expr->operands.push_back(unary());
+            return expr;
+        }
+        return primary();
+    }
+
+    std::unique_ptr<SourceExpr> primary() {
+        const SourceToken &token = peek();
+        if (token.kind == SourceTokenKind::Number || check("true") || check("false")) {
+            auto expr = make_expression(SourceExpr::Number, token.line);
+            expr->value = token.kind == SourceTokenKind::Number ? token.value : token.text == "true";
+            position++;
+            return expr;
+        }
+        if (accept("(")) {
+            auto expr = expression();
+            expect(")");
+            return expr;
+        }
+        if (token.kind == SourceTokenKind::String) fail("strings are not supported by the bytecode VM");
+        if (token.kind != SourceTokenKind::Identifier) fail("expected an expression");
+        auto expr = make_expression(SourceExpr::Name, token.line);
+        expr->text = identifier();
+        if (accept(".")) {
+            expr->qualifier = expr->text;
+            expr->text = identifier();
+        }
+        if (accept("(")) {
+            expr->kind = SourceExpr::Call;
+            while (!check(")")) {
+                expr->operands.push_back(expression());
+                if (!check(")")) expect(",");
+            }
+            expect(")");
+        }
+        return expr;
+    }
+};
+
+// Lowers one module to module-local bytecode. Reads the ASTs of the modules it imports,
+// which are not modified once parsing is done, so modules compile concurrently.
+class SourceCompiler {
+public:
+    explicit SourceCompiler(SourceModule &module) : module(module), out(module.code) {}
+
+    void compile() {
+        zero = slot(module.name + "$zero");
+        emit(0x10, zero, constant(0));   // Moves are adds of this slot
+        scopes.emplace_back();           // Module scope: its variables are the globals
+        for (const auto &stmt : module.statements) statement(*stmt);
+    }
+
+private:
+    struct Variable {
+        std::string_view name;
+        int32_t slot;
+        bool constant;
+    };
+
+    // An inline expansion in progress: returns store into result and jump past the body
+    struct InlineFrame {
+        const SourceFunction *function;
+        const SourceModule *owner;
+        int32_t result;
+        std::vector<size_t> exits;
+        size_t first_scope;   // The caller's variables are not visible to the callee
+    };
+
+    SourceModule &module;
+    CompiledModule &out;
+    std::unordered_map<std::string, int32_t> slot_index;
+    std::unordered_map<int64_t, int32_t> constant_index;
+    std::vector<std::vector<Variable>> scopes;
+    std::vector<InlineFrame> frames;
+    std::vector<int32_t> temps;   // Reused statement by statement
+    size_t temps_used = 0;
+    size_t counted_loops = 0;     // LOOP_BEGIN nesting at the current pc
+    uint64_t next_local = 0;
+    int32_t zero = 0;
+
+    [[noreturn]] void fail(int line, const std::string &message) const {
+        throw SourceError{owner()->path, line, message};
+    }
+
+    const SourceModule *owner() const { return frames.empty() ? &module : frames.back().owner; }
+
+    int32_t slot(const std::string &name) {
+        auto it = slot_index.find(name);
+        if (it != slot_index.end()) return it->second;
+        int32_t index = static_cast<int32_t>(out.slot_names.size());
+        out.slot_names.push_back(name);
+        slot_index[name] = index;
+        return index;
+    }
+
+    int32_t constant(int64_t value) {
+        auto it = constant_index.find(value);
+        if (it != constant_index.end()) return it->second;
+        int32_t index = static_cast<int32_t>(out.constants.size());
+        out.constants.push_back(value);
+        constant_index[value] = index;
+        return index;
+    }
+
+    int32_t temp() {
+        if (temps_used == temps.size()) temps.push_back(slot(module.name + "$t" + std::to_string(temps.size())));
+        return temps[temps_used++];
+    }
+
+    size_t here() const { return out.code.size(); }
+
+    size_t emit(uint8_t opcode, int32_t a, int32_t b = 0, int32_t c = 0) {
+        Instruction instruction = {};
+        instruction.opcode = opcode;
+        instruction.a = a;
+        instruction.b = b;
+        instruction.c = c;
+        out.code.push_back(instruction);
+        return out.code.size() - 1;
+    }
+
+    // Point a jump (0x30), if (0x31) or loop (0x32) at target
+    void patch(size_t pc, size_t target) {
+        Instruction &instruction = out.code[pc];
+        (instruction.opcode == 0x30 ? instruction.a : instruction.b) = static_cast<int32_t>(target);
+    }
+
+    void patch_all(const std::vector<size_t> &jumps, size_t target) {
+        for (size_t pc : jumps) patch(pc, target);
+    }
+
+    // Slot for a new variable: globals at module scope, a fresh local anywhere else
+    int32_t variable_slot(std::string_view name) {
+        if (frames.empty() && scopes.size() == 1) return slot(module.name + "." + std::string(name));
+        return slot(module.name + "$" + std::string(name) + "#" + std::to_string(next_local++));
+    }
+
+    void bind(std::string_view name, int32_t slot, bool constant) {
+        scopes.back().push_back({name, slot, constant});
+    }
+
+    const SourceModule *imported_module(std::string_view name, int line) const {
+        if (name == owner()->name) return owner();
+        for (const SourceModule *imported : owner()->imported) {
+            if (imported->name == name) return imported;
+        }
+        fail(line, "module '" + std::string(name) + "' is not imported");
+    }
+
+    Variable variable(std::string_view qualifier, std::string_view name, int line) {
+        if (qualifier.empty()) {
+            const size_t first = frames.empty() ? 0 : frames.back().first_scope;
+            for (size_t scope = scopes.size(); scope-- > first;) {
+                for (auto it = scopes[scope].rbegin(); it != scopes[scope].rend(); ++it) {
+                    if (it->name == name) return *it;
+                }
+            }
+        }
+        // Functions see every global of their module; top-level code only the ones declared so far
+        const SourceModule *home = qualifier.empty() ? owner() : imported_module(qualifier, line);
+        if (!qualifier.empty() || !frames.empty()) {
+            auto global = home->globals.find(name);
+            if (global != home->globals.end())
+                return {name, slot(home->name + "." + std::string(name)), global->second};
+        }
+        fail(line, "unknown variable '" + std::string(name) + "'");
+    }
+
+    // Compile-time value of an expression made of literals only
+    bool fold(const SourceExpr &expr, int64_t &value) const {
+        if (expr.kind == SourceExpr::Number) {
+            value = expr.value;
+            return true;
+        }
+        int64_t left, right = 0;
+        if ((expr.kind != SourceExpr::Unary && expr.kind != SourceExpr::Binary) || !fold(*expr.operands[0], left) ||
+            (expr.kind == SourceExpr::Binary && !fold(*expr.operands[1], right)))
+            return false;
+        const std::string_view op = expr.text;
+        if (expr.kind == SourceExpr::Unary) value = op == "-" ? wrapping_subtract(0, left) : !left;
+        else if (op == "+") value = wrapping_add(left, right);
+        else if (op == "-") value = wrapping_subtract(left, right);
+        else if (op == "*") value = wrapping_multiply(left, right);
+        else if (op == "/" || op == "%") {
+            if (right == 0 || (left == INT64_MIN && right == -1)) fail(expr.line, "division overflows or divides by zero");
+            value = op == "/" ? left / right : left % right;
+        }
+        else if (op == "==") value = left == right;
+        else if (op == "!=") value = left != right;
+        else if (op == "<") value = left < right;
+        else if (op == "<=") value = left <= right;
+        else if (op == ">") value = left > right;
+        else if (op == ">=") value = left >= right;
+        else if (op == "&&") value = left && right;
+        else value = left || right;
+        return true;
+    }
+
+    // Slot holding the value of expr; variables are read in place
+    int32_t value_of(const SourceExpr &expr) {
+        if (expr.kind == SourceExpr::Name) return variable(expr.qualifier, expr.text, expr.line).slot;
+        int32_t result = temp();
+        store(expr, result);
+        return result;
+    }
+
+    // Compute expr into destination
+    void store(const SourceExpr &expr, int32_t destination) {
+        int64_t folded;
+        if (fold(expr, folded)) {
+            emit(0x10, destination, constant(folded));
+            return;
+        }
+        const std::string_view op = expr.text;
+        switch (expr.kind) {
+            case SourceExpr::Name:
+                emit(0x20, variable(expr.qualifier, expr.text, expr.line).slot, zero, destination);
+                return;
+            case SourceExpr::Call:
+                call(expr, destination);
+                return;
+            case SourceExpr::Unary:
+                if (op == "-") {
+                    emit(0x21, zero, value_of(*expr.operands[0]), destination);
+                    return;
+                }
+                break;
+            case SourceExpr::Binary:
+                if (op == "+" || op == "-" || op == "*") {
+                    int32_t left = value_of(*expr.operands[0]);
+                    int32_t right = value_of(*expr.operands[1]);
+                    emit(op == "+" ? 0x20 : op == "-" ? 0x21 : 0x22, left, right, destination);
+                    return;
+                }
+                if (op == "/" || op == "%") fail(expr.line, "division is only supported between constants");
+                break;
+            default:
+                break;
+        }
+        // Comparisons and logic: 1 when the condition holds, else 0
+        std::vector<size_t> on_false;
+        branch(expr, false, on_false);
+        emit(0x10, destination, constant(1));
+        size_t done = emit(0x30, 0);
+        patch_all(on_false, here());
+        emit(0x10, destination, constant(0));
+        patch(done, here());
+    }
+
+    // Jump when slot is nonzero (if) or positive (loop), or when it is not
+    void test(int32_t value, bool positive, bool jump_when, std::vector<size_t> &jumps) {
+        const uint8_t opcode = positive ? 0x32 : 0x31;
+        if (jump_when) {
+            jumps.push_back(emit(opcode, value));
+            return;
+        }
+        size_t over = emit(opcode, value);
+        jumps.push_back(emit(0x30, 0));
+        patch(over, here());
+    }
+
+    // Emit jumps taken when the truth of expr equals jump_when and add them to jumps.
+    // The VM branches on nonzero (if) and positive (loop), so a comparison is one
+    // COMPARE and one of those, possibly inverted.
+    void branch(const SourceExpr &expr, bool jump_when, std::vector<size_t> &jumps) {
+        int64_t folded;
+        if (fold(expr, folded)) {
+            if ((folded != 0) == jump_when) jumps.push_back(emit(0x30, 0));
+            return;
+        }
+        const std::string_view op = expr.text;
+        if (expr.kind == SourceExpr::Unary && op == "!") {
+            branch(*expr.operands[0], !jump_when, jumps);
+            return;
+        }
+        if (expr.kind == SourceExpr::Binary && (op == "&&" || op == "||")) {
+            if ((op == "&&") != jump_when) {   // Either operand alone decides
+                branch(*expr.operands[0], jump_when, jumps);
+                branch(*expr.operands[1], jump_when, jumps);
+            } else {
+                std::vector<size_t> decided;
+                branch(*expr.operands[0], !jump_when, decided);
+                branch(*expr.operands[1], jump_when, jumps);
+                patch_all(decided, here());
+            }
+            return;
+        }
+        if (expr.kind == SourceExpr::Binary && (op == "<" || op == ">" || op == "<=" || op == ">=" || op == "==" || op == "!=")) {
+            // order = COMPARE(left, right), or COMPARE(right, left) for < and >=; then test it.
+            // Against a literal zero the value itself already has the right sign.
+            const bool swap = op == "<" || op == ">=";
+            const bool positive = op != "==" && op != "!=";
+            const bool holds = op == "<" || op == ">" || op == "!=";
+            const SourceExpr &first = *expr.operands[swap ? 1 : 0];
+            const SourceExpr &second = *expr.operands[swap ? 0 : 1];
+            int32_t order;
+            if (fold(second, folded) && folded == 0) {
+                order = value_of(first);
+            } else {
+                int32_t left = value_of(first);
+                int32_t right = value_of(second);
+                order = temp();
+                emit(0x24, left, right, order);
+            }
+            test(order, positive, holds == jump_when, jumps);
+            return;
+        }
+        test(value_of(expr), false, jump_when, jumps);
+    }
+
+    const SourceFunction *find_function(const SourceExpr &expr, const SourceModule *&home) const {
+        const SourceModule *context = owner();
+        std::vector<const SourceModule *> candidates;
+        if (!expr.qualifier.empty()) {
+            candidates.push_back(imported_module(expr.qualifier, expr.line));
+        } else {
+            candidates.push_back(context);
+            candidates.insert(candidates.end(), context->imported.begin(), context->imported.end());
+        }
+        for (const SourceModule *candidate : candidates) {
+            auto it = candidate->functions.find(expr.text);
+            if (it != candidate->functions.end()) {
+                home = candidate;
+                return &it->second;
+            }
+        }
+        fail(expr.line, "unknown function '" + std::string(expr.text) + "'");
+    }
+
+    // Expand a call in place: arguments go to fresh parameter slots, the body runs in its
+    // own scope and every return stores into result and jumps past the body
+    void call(const SourceExpr &expr, int32_t result) {
+        const SourceModule *home = nullptr;
+        const SourceFunction *function = find_function(expr, home);
+        for (const InlineFrame &frame : frames) {
+            if (frame.function == function)
+                fail(expr.line, "'" + std::string(function->name) + "' is recursive; calls are expanded inline");
+        }
+        if (expr.operands.size() != function->params.size())
+            fail(expr.line, "'" + std::string(function->name) + "' takes " + std::to_string(function->params.size()) +
+                                " arguments, not " + std::to_string(expr.operands.size()));
+
+        std::vector<int32_t> params;
+        for (size_t i = 0; i < expr.operands.size(); ++i) {
+            params.push_back(slot(module.name + "$" + std::string(function->name) + "." + std::string(function->params[i]) +
+                                  "#" + std::to_string(next_local++)));
+            store(*expr.operands[i], params.back());
+        }
+        const bool ends_in_return = !function->body.empty() && function->body.back()->kind == SourceStmt::Return;
+        if (!ends_in_return) emit(0x10, result, constant(0));   // Falling off the end returns 0
+
+        frames.push_back({function, home, result, {}, scopes.size()});
+        scopes.emplace_back();
+        for (size_t i = 0; i < params.size(); ++i) bind(function->params[i], params[i], false);
+        for (size_t i = 0; i < function->body.size(); ++i) {
+            const SourceStmt &stmt = *function->body[i];
+            if (i + 1 == function->body.size() && stmt.kind == SourceStmt::Return) {
+                // The final return falls through instead of jumping
+                size_t mark = temps_used;
+                if (stmt.value) store(*stmt.value, result);
+                temps_used = mark;
+            } else {
+                statement(stmt);
+            }
+        }
+        scopes.pop_back();
+        patch_all(frames.back().exits, here());
+        frames.pop_back();
+    }
+
+    static bool contains_return(const SourceBlock &body) {
+        for (const auto &stmt : body) {
+            if (stmt->kind == SourceStmt::Return || contains_return(stmt->body) || contains_return(stmt->alternative))
+                return true;
+            for (const SourceArm &arm : stmt->arms) {
+                if (contains_return(arm.body)) return true;
+            }
+        }
+        return false;
+    }
+
+    void block(const SourceBlock &body) {
+        scopes.emplace_back();
+        for (const auto &stmt : body) statement(*stmt);
+        scopes.pop_back();
+    }
+
+    // A range loop is a counted loop (the engines keep its trip counter) unless it is
+    // nested too deeply or holds a return, which would jump out of the counted body
+    void range_loop(const SourceStmt &stmt) {
+        scopes.emplace_back();
+        int32_t counter = slot(module.name + "$" + std::string(stmt.name) + "#" + std::to_string(next_local++));
+        int32_t limit = temp();
+        store(*stmt.value, counter);
+        store(*stmt.limit, limit);
+        int32_t step = temp();
+        emit(0x10, step, constant(1));
+        if (stmt.inclusive) emit(0x20, limit, step, limit);
+        bind(stmt.name, counter, false);
+
+        const bool counted = counted_loops < MAX_LOOP_DEPTH && (frames.empty() || !contains_return(stmt.body));
+        if (counted) {
+            int32_t trips = temp();
+            emit(0x21, limit, counter, trips);
+            size_t begin = emit(0x33, trips);
+            counted_loops++;
+            block(stmt.body);
+            counted_loops--;
+            emit(0x20, counter, step, counter);
+            out.code[begin].b = static_cast<int32_t>(emit(0x34, static_cast<int32_t>(begin)));
+        } else {
+            size_t top = here();
+            int32_t remaining = temp();
+            emit(0x24, limit, counter, remaining);
+            std::vector<size_t> exits;
+            test(remaining, true, false, exits);
+            block(stmt.body);
+            emit(0x20, counter, step, counter);
+            emit(0x30, static_cast<int32_t>(top));
+            patch_all(exits, here());
+        }
+        scopes.pop_back();
+    }
+
+    // match dispatches through a switch table; the first arm for a value wins
+    void match(const SourceStmt &stmt) {
+        int32_t subject = value_of(*stmt.value);
+        size_t dispatch = emit(0x36, subject);   // Table and opcode are set once the arms are placed
+        std::vector<std::pair<int64_t, int64_t>> cases;
+        int64_t default_target = -1;
+        std::vector<size_t> ends;
+        for (size_t i = 0; i < stmt.arms.size(); ++i) {
+            const SourceArm &arm = stmt.arms[i];
+            const int64_t target = static_cast<int64_t>(here());
+            if (arm.wildcard) {
+                if (default_target < 0) default_target = target;
+            } else if (std::none_of(cases.begin(), cases.end(), [&](const auto &entry) { return entry.first == arm.key; })) {
+                cases.push_back({arm.key, target});
+            }
+            block(arm.body);
+            if (i + 1 < stmt.arms.size()) ends.push_back(emit(0x30, 0));
+        }
+        patch_all(ends, here());
+        if (default_target < 0) default_target = static_cast<int64_t>(here());
+
+        std::sort(cases.begin(), cases.end());
+        CompiledTable table;
+        table.dense = !cases.empty() && switch_values_are_dense(cases.front().first, cases.back().first, cases.size());
+        if (table.dense) {
+            const int64_t min = cases.front().first;
+            const int64_t count = cases.back().first - min + 1;
+            table.values = {min, count, default_target};
+            table.values.resize(3 + count, default_target);
+            for (const auto &entry : cases) table.values[3 + (entry.first - min)] = entry.second;
+        } else {
+            table.values = {static_cast<int64_t>(cases.size()), default_target};
+            for (const auto &entry : cases) table.values.push_back(entry.first);
+            for (const auto &entry : cases) table.values.push_back(entry.second);
+        }
+        out.code[dispatch].opcode = table.dense ? 0x35 : 0x36;
+        out.code[dispatch].b = static_cast<int32_t>(out.tables.size());
+        out.tables.push_back(std::move(table));
+    }
+
+    void statement(const SourceStmt &stmt) {
+        const size_t mark = temps_used;
+        switch (stmt.kind) {
+            case SourceStmt::Let: {
+                int32_t target = variable_slot(stmt.name);
+                store(*stmt.value, target);   // Before binding, so the initializer sees any outer name
+                bind(stmt.name, target, stmt.constant);
+                break;
+            }
+            case SourceStmt::Assign: {
+                Variable target = variable({}, stmt.name, stmt.line);
+                if (target.constant) fail(stmt.line, "cannot assign to constant '" + std::string(stmt.name) + "'");
+                store(*stmt.value, target.slot);
+                break;
+            }
+            case SourceStmt::Print:
+                emit(0x40, value_of(*stmt.value));
+                break;
+            case SourceStmt::If: {
+                std::vector<size_t> on_false;
+                branch(*stmt.value, false, on_false);
+                block(stmt.body);
+                if (!stmt.alternative.empty()) {
+                    size_t done = emit(0x30, 0);
+                    patch_all(on_false, here());
+                    block(stmt.alternative);
+                    patch(done, here());
+                } else {
+                    patch_all(on_false, here());
+                }
+                break;
+            }
+            case SourceStmt::While: {
+                size_t top = here();
+                std::vector<size_t> exits;
+                branch(*stmt.value, false, exits);
+                block(stmt.body);
+                emit(0x30, static_cast<int32_t>(top));
+                patch_all(exits, here());
+                break;
+            }
+            case SourceStmt::For:
+                range_loop(stmt);
+                break;
+            case SourceStmt::Match:
+                match(stmt);
+                break;
+            case SourceStmt::Return:
+                if (frames.empty()) fail(stmt.line, "return outside a function");
+                if (stmt.value) store(*stmt.value, frames.back().result);
+                frames.back().exits.push_back(emit(0x30, 0));
+                break;
+            case SourceStmt::Evaluate:
+                if (stmt.value->kind == SourceExpr::Call) call(*stmt.value, temp());
+                else value_of(*stmt.value);
+                break;
+        }
+        temps_used = mark;
+    }
+};
+
+// Compile threads: CONTOUR_COMPILE_THREADS=n, else one per hardware thread
+size_t compile_threads = 0;
+
+void configure_compile_threads_from_env() {
+    const char *threads = std::getenv("CONTOUR_COMPILE_THREADS");
+    if (threads) compile_threads = static_cast<size_t>(std::strtoul(threads, nullptr, 10));
+}
+
+// Run job(i) for every i below count on a pool of worker threads, the caller included
+template <typename Job>
+void run_parallel(size_t count, const Job &job) {
+    size_t workers = compile_threads ? compile_threads : std::max(1u, std::thread::hardware_concurrency());
+    workers = std::min(workers, count);
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < count; i = next++) job(i);
+    };
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < workers; ++i) pool.emplace_back(work);
+    work();
+    for (std::thread &thread : pool) thread.join();
+}
+
+void parse_contour_module(SourceModule &module) {
+    try {
+        std::ifstream file(module.path, std::ios::binary);
+        if (!file) {
+            module.error = (module.import_site.empty() ? module.path : module.import_site) + ": error: cannot open " + module.path;
+            return;
+        }
+        module.text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        module.content_hash = hash_bytes(module.text.data(), module.text.size());
+        SourceParser(module).parse_module();
+    } catch (const SourceError &error) {
+        module.error = error.path + ":" + std::to_string(error.line) + ": error: " + error.message;
+    }
+}
+
+void compile_contour_module(SourceModule &module) {
+    try {
+        SourceCompiler(module).compile();
+    } catch (const SourceError &error) {
+        module.error = error.path + ":" + std::to_string(error.line) + ": error: " + error.message;
+    }
+}
+
+void report_source_errors(const std::vector<std::unique_ptr<SourceModule>> &modules) {
+    bool failed = false;
+    for (const auto &module : modules) {
+        if (module->error.empty()) continue;
+        std::cerr << module->error << std::endl;
+        failed = true;
+    }
+    if (failed) exit(1);
+}
+
+// Append the compiled modules to binary_program in order, giving every slot name its
+// memory slot and moving constants, switch tables and jump targets to global positions
+void link_contour_modules(const std::vector<SourceModule *> &order) {
+    size_t names = 0;
+    for (const SourceModule *module : order) names += module->code.slot_names.size();
+    if (memory.size() < memory_index + names) memory.resize(memory_index + names, 0);
+
+    for (const SourceModule *module : order) {
+        const CompiledModule &code = module->code;
+        const int32_t base = static_cast<int32_t>(binary_program.size());
+        std::vector<int32_t> slots, constants, tables;
+        for (const std::string &name : code.slot_names) slots.push_back(static_cast<int32_t>(resolve_variable_slot(name)));
+        for (int64_t value : code.constants) constants.push_back(intern_constant(value));
+        for (const CompiledTable &table : code.tables) {
+            std::vector<int64_t> values = table.values;
+            const size_t header = table.dense ? 3 : 2;
+            const size_t first_target = header + (table.dense ? 0 : static_cast<size_t>(values[0]));
+            values[header - 1] += base;   // Default target
+            for (size_t i = first_target; i < values.size(); ++i) values[i] += base;
+            tables.push_back(append_constants(values));
+        }
+        for (Instruction instruction : code.code) {
+            switch (instruction.opcode) {
+                case 0x10: // let
+                    instruction.a = slots[instruction.a];
+                    instruction.b = constants[instruction.b];
+                    break;
+                case 0x20: case 0x21: case 0x22: case 0x24: // arithmetic, compare
+                    instruction.a = slots[instruction.a];
+                    instruction.b = slots[instruction.b];
+                    instruction.c = slots[instruction.c];
+                    break;
+                case 0x30: case 0x34: // jmp, loop-end
+                    instruction.a += base;
+                    break;
+                case 0x31: case 0x32: case 0x33: // if, loop, loop-begin
+                    instruction.a = slots[instruction.a];
+                    instruction.b += base;
+                    break;
+                case 0x35: case 0x36: // switch-table, switch-search
+                    instruction.a = slots[instruction.a];
+                    instruction.b = tables[instruction.b];
+                    break;
+                case 0x40: // print
+                    instruction.a = slots[instruction.a];
+                    break;
+            }
+            binary_program.push_back(instruction);
+        }
+    }
+    bind_program_view();
+}
+
+// Compile the given modules and everything they import into binary_program. Imports are
+// looked up as <name>.ctr next to the importing file; modules run imports first. Returns
+// every file that was read, for the compiled-program cache.
+SourceHashes compile_contour_program(const std::vector<std::string> &files) {
+    std::vector<std::unique_ptr<SourceModule>> modules;
+    std::unordered_map<std::string, SourceModule *> by_name;
+    auto add_module = [&](const std::string &path) {
+        size_t slash = path.find_last_of('/');
+        std::string name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".ctr") == 0) name.resize(name.size() - 4);
+        if (by_name.count(name)) {
+            std::cerr << "Error: Two modules are named " << name << std::endl;
+            exit(1);
+        }
+        modules.push_back(std::make_unique<SourceModule>());
+        modules.back()->name = name;
+        modules.back()->path = path;
+        by_name[name] = modules.back().get();
+    };
+    for (const std::string &file : files) add_module(file);
+
+    // Parse in waves: each wave's imports that are not loaded yet form the next one
+    for (size_t parsed = 0; parsed < modules.size();) {
+        const size_t wave_end = modules.size();
+        run_parallel(wave_end - parsed, [&](size_t i) { parse_contour_module(*modules[parsed + i]); });
+        report_source_errors(modules);
+        for (; parsed < wave_end; ++parsed) {
+            SourceModule &module = *modules[parsed];
+            size_t slash = module.path.find_last_of('/');
+            std::string directory = slash == std::string::npos ? "" : module.path.substr(0, slash + 1);
+            for (const auto &import : module.imports) {
+                std::string name(import.first);
+                if (!by_name.count(name)) {
+                    add_module(directory + name + ".ctr");
+                    modules.back()->import_site = module.path + ":" + std::to_string(import.second);
+                }
+                module.imported.push_back(by_name[name]);
+            }
+        }
+    }
+
+    // Imports run before their importers; a cycle has no such order
+    std::vector<SourceModule *> order;
+    std::unordered_map<const SourceModule *, int> state;   // 1 visiting, 2 done
+    std::function<void(SourceModule *)> visit = [&](SourceModule *module) {
+        if (state[module] == 2) return;
+        if (state[module] == 1) {
+            std::cerr << "Error: Import cycle through module " << module->name << std::endl;
+            exit(1);
+        }
+        state[module] = 1;
+        for (const SourceModule *imported : module->imported) visit(by_name[imported->name]);
+        state[module] = 2;
+        order.push_back(module);
+    };
+    for (const auto &module : modules) visit(module.get());
+
+    run_parallel(modules.size(), [&](size_t i) { compile_contour_module(*modules[i]); });
+    report_source_errors(modules);
+    link_contour_modules(order);
+
+    SourceHashes sources;
+    for (const auto &module : modules) sources.push_back({module->path, module->content_hash});
+    return sources;
+}
+
+void reject_instruction(size_t pc, const Instruction &instruction, const std::string &reason) {
+    std::cerr << "Error: Verification failed at instruction " << pc << " (opcode 0x" << std::hex
+              << (int)instruction.opcode << std::dec << "): " << reason << std::endl;
+    exit(1);
+}
+
+// Load-time verifier. Proves every opcode is known, every memory operand lies inside
+// memory, every constant index lies inside the pool, every jump target lies inside
+// the program (the program size itself means "halt") and counted loops are well nested.
+// The engines rely on this and do no bounds checks of their own.
+void verify_binary_program() {
+    const size_t program_size = active_program.size;
+    auto in_memory = [](int32_t slot) { return slot >= 0 && static_cast<size_t>(slot) < memory.size(); };
+
+    // Counted loops must nest properly. enclosing_loop[pc] is the LOOP_BEGIN whose body
+    // holds pc (the LOOP_END counts as body), or program_size at the top level.
+    std::vector<size_t> enclosing_loop(program_size, program_size);
+    std::vector<size_t> open_loops;
+    for (size_t pc = 0; pc < program_size; ++pc) {
+        const Instruction &instruction = active_program.code[pc];
+        enclosing_loop[pc] = open_loops.empty() ? program_size : open_loops.back();
+        if (base_opcode_of(instruction) == 0x33) {
+            if (instruction.b <= static_cast<int64_t>(pc) || static_cast<size_t>(instruction.b) >= program_size ||
+                base_opcode_of(active_program.code[instruction.b]) != 0x34 ||
+                active_program.code[instruction.b].a != static_cast<int64_t>(pc))
+                reject_instruction(pc, instruction, "loop-begin is not paired with its loop-end");
+            if (open_loops.size() == MAX_LOOP_DEPTH) reject_instruction(pc, instruction, "loops nested too deeply");
+            open_loops.push_back(pc);
+        } else if (base_opcode_of(instruction) == 0x34) {
+            if (open_loops.empty() || static_cast<int64_t>(open_loops.back()) != instruction.a)
+                reject_instruction(pc, instruction, "loop-end does not close the innermost loop");
+            open_loops.pop_back();
+        }
+    }
+    if (!open_loops.empty())
+        reject_instruction(open_loops.back(), active_program.code[open_loops.back()], "loop-begin is never closed");
+
+    // Branches may not enter or leave a counted loop body, except to halt
+    auto check_target = [&](size_t pc, const Instruction &instruction, int32_t target) {
+        if (target < 0 || static_cast<size_t>(target) > program_size)
+            reject_instruction(pc, instruction, "jump target out of bounds");
+        if (static_cast<size_t>(target) != program_size && enclosing_loop[target] != enclosing_loop[pc])
+            reject_instruction(pc, instruction, "jump crosses a counted loop boundary");
+    };
+
+    for (size_t pc = 0; pc < program_size; ++pc) {
+        const Instruction &instruction = active_program.code[pc];
+        if (is_fused_opcode(instruction.opcode)) {
+            const FusionRule *rule = pc + 1 < program_size
+                ? find_fusion_rule(instruction.base_opcode, base_opcode_of(active_program.code[pc + 1]))
+                : nullptr;
+            if (!rule || rule->fused != instruction.opcode)
+                reject_instruction(pc, instruction, "superinstruction does not match its pair");
+        }
+        switch (base_opcode_of(instruction)) {
+            case 0x10: // let
+                if (!in_memory(instruction.a)) reject_instruction(pc, instruction, "slot out of bounds");
+                if (instruction.b < 0 || static_cast<size_t>(instruction.b) >= active_program.constant_count)
+                    reject_instruction(pc, instruction, "constant index out of bounds");
+                break;
+            case 0x20: case 0x21: case 0x22: case 0x24: // arithmetic, compare
+                if (!in_memory(instruction.a) || !in_memory(instruction.b) || !in_memory(instruction.c))
+                    reject_instruction(pc, instruction, "memory operand out of bounds");
+                break;
+            case 0x30: // jmp
+                check_target(pc, instruction, instruction.a);
+                break;
+            case 0x31: case 0x32: // if, loop
+                if (!in_memory(instruction.a)) reject_instruction(pc, instruction, "memory operand out of bounds");
+                check_target(pc, instruction, instruction.b);
+                break;
+            case 0x33: // loop-begin (pairing checked above)
+                if (!in_memory(instruction.a)) reject_instruction(pc, instruction, "memory operand out of bounds");
+                break;
+            case 0x34: // loop-end
+                break;
+            case 0x35: case 0x36: { // switch-table, switch-search
+                if (!in_memory(instruction.a)) reject_instruction(pc, instruction, "memory operand out of bounds");
+                const bool dense = base_opcode_of(instruction) == 0x35;
+                const size_t header = dense ? 3 : 2;
+                const size_t pool = active_program.constant_count;
+                if (instruction.b < 0 || static_cast<size_t>(instruction.b) + header > pool)
+                    reject_instruction(pc, instruction, "switch table out of bounds");
+                const int64_t *table = active_program.constants + instruction.b;
+                const int64_t count = table[dense ? 1 : 0];
+                const size_t entries = dense ? 1 : 2;
+                if (count < 0 || static_cast<uint64_t>(count) > (pool - instruction.b - header) / entries)
+                    reject_instruction(pc, instruction, "switch table out of bounds");
+                const int64_t *targets = table + header + (dense ? 0 : count);
+                auto check_switch_target = [&](int64_t target) {
+                    if (target < 0 || target > INT32_MAX) reject_instruction(pc, instruction, "jump target out of bounds");
+                    check_target(pc, instruction, static_cast<int32_t>(target));
+                };
+                check_switch_target(table[dense ? 2 : 1]);
+                for (int64_t i = 0; i < count; ++i) {
+                    check_switch_target(targets[i]);
+                    if (!dense && i > 0 && table[2 + i - 1] >= table[2 + i])
+                        reject_instruction(pc, instruction, "switch keys are not sorted");
+                }
+                break;
+            }
+            case 0x40: case 0x71: // print, free
+                if (!in_memory(instruction.a)) reject_instruction(pc, instruction, "memory operand out of bounds");
+                break;
+            case 0x70: // malloc
+                if (instruction.a < 0 || static_cast<size_t>(instruction.a) >= active_program.constant_count)
+                    reject_instruction(pc, instruction, "constant index out of bounds");
+                if (!in_memory(instruction.c)) reject_instruction(pc, instruction, "memory operand out of bounds");
+                break;
+            default:
+                reject_instruction(pc, instruction, "unknown opcode");
+        }
+    }
+    program_verified = true;
+}
+
+// Fusion candidates seen by a profiled run, indexed by (first << 8) | second
+bool profile_dispatch = false;
+std::vector<uint64_t> opcode_pair_counts;
+
+void start_dispatch_profile() {
+    profile_dispatch = true;
+    opcode_pair_counts.assign(1 << 16, 0);
+}
+
+// Every rule with a handler
+std::vector<FusionRule> default_fusion_set() {
+    return std::vector<FusionRule>(std::begin(fusion_rules), std::end(fusion_rules));
+}
+
+// Rules whose pair fell through at least min_count times in the profiled run
+std::vector<FusionRule> profiled_fusion_set(uint64_t min_count) {
+    std::vector<FusionRule> selected;
+    for (const FusionRule &rule : fusion_rules) {
+        uint64_t count = opcode_pair_counts.empty() ? 0 : opcode_pair_counts[(rule.first << 8) | rule.second];
+        if (count >= min_count) selected.push_back(rule);
+    }
+    return selected;
+}
+
+// Print the hottest adjacent opcode pairs, including ones that have no handler yet
+void report_opcode_pairs(size_t limit) {
+    std::vector<std::pair<uint64_t, uint16_t>> pairs;
+    for (size_t key = 0; key < opcode_pair_counts.size(); ++key) {
+        if (opcode_pair_counts[key]) pairs.push_back({opcode_pair_counts[key], static_cast<uint16_t>(key)});
+    }
+    std::sort(pairs.rbegin(), pairs.rend());
+    for (size_t i = 0; i < pairs.size() && i < limit; ++i) {
+        const FusionRule *rule = find_fusion_rule(pairs[i].second >> 8, pairs[i].second & 0xFF);
+        std::cout << "Pair 0x" << std::hex << (pairs[i].second >> 8) << " 0x" << (pairs[i].second & 0xFF) << std::dec
+                  << ": " << pairs[i].first << (rule ? std::string(" -> ") + rule->name : std::string(" (no handler)"))
+                  << std::endl;
+    }
+}
+
+// Rewrite every matching adjacent pair of a verified program into its superinstruction.
+// Returns the number of instructions fused.
+size_t fuse_superinstructions(const std::vector<FusionRule> &rules) {
+    size_t fused = 0;
+    for (size_t pc = 0; pc + 1 < active_program.size; ++pc) {
+        Instruction &instruction = active_program.code[pc];
+        if (is_fused_opcode(instruction.opcode)) continue;
+        uint8_t second = base_opcode_of(active_program.code[pc + 1]);
+        for (const FusionRule &rule : rules) {
+            if (rule.first == instruction.opcode && rule.second == second) {
+                instruction.base_opcode = instruction.opcode;
+                instruction.opcode = rule.fused;
+                fused++;
+                break;
+            }
+        }
+    }
+    return fused;
+}
+
+// Baseline template JIT for Linux x86-64. Straight-line runs and loops of LET, arithmetic,
+// JUMP, IF and LOOP are translated into native code once their entry has been branched to
+// jit_threshold times. A block is entered with rdi = memory.data() and returns the pc the
+// interpreter should resume at, so anything the JIT does not support deoptimizes by
+// simply exiting at that instruction.
+#if defined(__x86_64__) && defined(__linux__) && CONTOUR_HAS_MMAP
+#define CONTOUR_JIT 1
+#else
+#define CONTOUR_JIT 0
+#endif
+
+using JitBlock = size_t (*)(int64_t *memory);
+
+bool jit_enabled = CONTOUR_JIT;
+bool jit_active = false;               // Set for the current program by prepare_binary_program()
+uint32_t jit_threshold = 1000;
+const size_t JIT_MAX_BLOCK = 4096;     // Instructions per compiled region
+std::vector<uint32_t> block_counters;  // Branches taken to each pc
+std::vector<JitBlock> jit_blocks;      // Native entry for each pc, if compiled
+std::vector<std::pair<void *, size_t>> jit_regions;
+
+// CONTOUR_JIT=off disables compilation, CONTOUR_JIT_THRESHOLD=n sets the hotness trigger
+void configure_jit_from_env() {
+    const char *mode = std::getenv("CONTOUR_JIT");
+    if (mode && std::string(mode) == "off") jit_enabled = false;
+    const char *threshold = std::getenv("CONTOUR_JIT_THRESHOLD");
+    if (threshold) jit_threshold = static_cast<uint32_t>(std::max(1L, std::strtol(threshold, nullptr, 10)));
+}
+
+void jit_reset() {
+#if CONTOUR_JIT
+    for (const auto &region : jit_regions) munmap(region.first, region.second);
+#endif
+    jit_regions.clear();
+    jit_blocks.clear();
+    block_counters.clear();
+    jit_active = false;
+}
+
+#if CONTOUR_JIT
+class JitAssembler {
+public:
+    std::vector<uint8_t> bytes;
+
+    void emit(std::initializer_list<uint8_t> code) { bytes.insert(bytes.end(), code); }
+    void emit32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+    void emit64(uint64_t value) {
+        for (int i = 0; i < 8; ++i) bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+    void patch32(size_t at, uint32_t value) {
+        for (int i = 0; i < 4; ++i) bytes[at + i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+    // Memory operand [rdi + slot * 8] with the ModRM byte for the given register field
+    void slot_operand(uint8_t modrm, int32_t slot) {
+        emit({modrm});
+        emit32(static_cast<uint32_t>(slot * 8));
+    }
+    // mov eax, pc; ret
+    void exit_to(size_t pc) {
+        emit({0xB8});
+        emit32(static_cast<uint32_t>(pc));
+        emit({0xC3});
+    }
+};
+
+bool jit_supports(uint8_t opcode) {
+    switch (opcode) {
+        case 0x10: case 0x20: case 0x21: case 0x22: case 0x24: case 0x30: case 0x31: case 0x32:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Translate the region starting at entry; nullptr when its first instruction is unsupported
+JitBlock jit_compile_block(size_t entry) {
+    const Instruction *code = active_program.code;
+    size_t end = entry;
+    while (end < active_program.size && end - entry < JIT_MAX_BLOCK && jit_supports(base_opcode_of(code[end]))) end++;
+    if (end == entry) return nullptr;
+
+    JitAssembler jit;
+    std::vector<size_t> offsets(end - entry);
+    std::vector<std::pair<size_t, size_t>> fixups;   // rel32 position, target pc
+    auto branch_to = [&](std::initializer_list<uint8_t> jump, std::initializer_list<uint8_t> skip, size_t target) {
+        if (target >= entry && target < end) {
+            jit.emit(jump);
+            fixups.push_back({jit.bytes.size(), target});
+            jit.emit32(0);
+        } else {
+            jit.emit(skip);        // Short branch over the exit stub
+            jit.exit_to(target);
+        }
+    };
+
+    for (size_t pc = entry; pc < end; ++pc) {
+        const Instruction &instruction = code[pc];
+        offsets[pc - entry] = jit.bytes.size();
+        switch (base_opcode_of(instruction)) {
+            case 0x10: // let: mov rax, imm64; mov [rdi+a], rax
+                jit.emit({0x48, 0xB8});
+                jit.emit64(static_cast<uint64_t>(active_program.constants[instruction.b]));
+                jit.emit({0x48, 0x89});
+                jit.slot_operand(0x87, instruction.a);
+                break;
+            case 0x20: case 0x21: case 0x22: // mov rax, [rdi+a]; op rax, [rdi+b]; mov [rdi+c], rax
+                jit.emit({0x48, 0x8B});
+                jit.slot_operand(0x87, instruction.a);
+                if (base_opcode_of(instruction) == 0x20) jit.emit({0x48, 0x03});
+                else if (base_opcode_of(instruction) == 0x21) jit.emit({0x48, 0x2B});
+                else jit.emit({0x48, 0x0F, 0xAF});
+                jit.slot_operand(0x87, instruction.b);
+                jit.emit({0x48, 0x89});
+                jit.slot_operand(0x87, instruction.c);
+                break;
+            case 0x24: // compare: mov rax, [rdi+a]; cmp rax, [rdi+b]; setg al; setl cl; sub al, cl; movsx rax, al
+                jit.emit({0x48, 0x8B});
+                jit.slot_operand(0x87, instruction.a);
+                jit.emit({0x48, 0x3B});
+                jit.slot_operand(0x87, instruction.b);
+                jit.emit({0x0F, 0x9F, 0xC0, 0x0F, 0x9C, 0xC1, 0x28, 0xC8, 0x48, 0x0F, 0xBE, 0xC0});
+                jit.emit({0x48, 0x89});
+                jit.slot_operand(0x87, instruction.c);
+                break;
+            case 0x30: // jmp
+                if (static_cast<size_t>(instruction.a) >= entry && static_cast<size_t>(instruction.a) < end) {
+                    jit.emit({0xE9});
+                    fixups.push_back({jit.bytes.size(), static_cast<size_t>(instruction.a)});
+                    jit.emit32(0);
+                } else {
+                    jit.exit_to(instruction.a);
+                }
+                break;
+            case 0x31: // if: cmp qword [rdi+a], 0; jne target
+                jit.emit({0x48, 0x83});
+                jit.slot_operand(0xBF, instruction.a);
+                jit.emit({0x00});
+                branch_to({0x0F, 0x85}, {0x74, 0x06}, instruction.b);
+                break;
+            case 0x32: // loop: taken while the count is positive; cmp qword [rdi+a], 0; jg target
+                jit.emit({0x48, 0x83});
+                jit.slot_operand(0xBF, instruction.a);
+                jit.emit({0x00});
+                branch_to({0x0F, 0x8F}, {0x7E, 0x06}, instruction.b);
+                break;
+        }
+    }
+    jit.exit_to(end);   // Fall out of the region back into the interpreter
+
+    for (const auto &fixup : fixups) {
+        int64_t relative = static_cast<int64_t>(offsets[fixup.second - entry]) - static_cast<int64_t>(fixup.first + 4);
+        jit.patch32(fixup.first, static_cast<uint32_t>(static_cast<int32_t>(relative)));
+    }
+
+    size_t length = jit.bytes.size();
+    void *region = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) return nullptr;
+    std::memcpy(region, jit.bytes.data(), length);
+    if (mprotect(region, length, PROT_READ | PROT_EXEC) != 0) {
+        munmap(region, length);
+        return nullptr;
+    }
+    jit_regions.push_back({region, length});
+    return reinterpret_cast<JitBlock>(region);
+}
+#endif
+
+// Called on every taken branch. Counts the target, compiles it once it is hot and runs
+// compiled blocks until control leaves native code.
+size_t jit_enter(size_t target) {
+#if CONTOUR_JIT
+    while (target < active_program.size) {
+        if (JitBlock block = jit_blocks[target]) {
+            target = block(memory.data());
+            continue;
+        }
+        if (++block_counters[target] == jit_threshold && (jit_blocks[target] = jit_compile_block(target))) continue;
+        break;
+    }
+#endif
+    return target;
+}
+
+inline size_t take_branch(size_t target) {
+    return jit_active ? jit_enter(target) : target;
+}
+
+// Dispatch engines: direct-threaded code where the compiler supports labels-as-values,
+// the plain switch loop everywhere else. Build with -DCONTOUR_THREADED_DISPATCH=0 to
+// force the portable engine.
+#ifndef CONTOUR_THREADED_DISPATCH
+#if defined(__GNUC__) || defined(__clang__)
+#define CONTOUR_THREADED_DISPATCH 1
+#else
+#define CONTOUR_THREADED_DISPATCH 0
+#endif
+#endif
+
+enum class DispatchMode { Switch, Threaded, Register };
+DispatchMode dispatch_mode = CONTOUR_THREADED_DISPATCH ? DispatchMode::Threaded : DispatchMode::Switch;
+
+// Runtime override: CONTOUR_DISPATCH=switch, threaded or register
+void configure_dispatch_from_env() {
+    const char *mode = std::getenv("CONTOUR_DISPATCH");
+    if (!mode) return;
+    if (std::string(mode) == "switch") {
+        dispatch_mode = DispatchMode::Switch;
+    } else if (std::string(mode) == "register") {
+        dispatch_mode = DispatchMode::Register;
+    } else if (std::string(mode) == "threaded" && CONTOUR_THREADED_DISPATCH) {
+        dispatch_mode = DispatchMode::Threaded;
+    } else {
+        std::cerr << "Warning: Unsupported dispatch mode '" << mode << "', keeping default." << std::endl;
+    }
+}
+
+// Prefix PRINT writes before each value
+std::string print_label = "Value: ";
+
+// Portable engine: one switch per instruction
+void execute_binary_program_switch() {
+    const Instruction *code = active_program.code;
+    const size_t program_size = active_program.size;
+    const int64_t *constants = active_program.constants;
+    size_t pc = program_counter;
+    size_t previous_pc = program_size;   // No predecessor yet
+    int64_t loop_counter = 0;
+    int64_t loop_counters[MAX_LOOP_DEPTH];
+    size_t loop_depth = 0;
+    while (pc < program_size) {
+        const Instruction &instruction = code[pc];
+        const Instruction *next = &instruction + 1;   // Only read by superinstructions
+
+        if (profile_dispatch) {
+            if (pc == previous_pc + 1)
+                opcode_pair_counts[(base_opcode_of(code[previous_pc]) << 8) | base_opcode_of(instruction)]++;
+            previous_pc = pc;
+        }
+
+        switch (instruction.opcode) {
+            case 0x10: // let
+                memory[instruction.a] = constants[instruction.b];
+                break;
+            case 0x20: // add
+                memory[instruction.c] = wrapping_add(memory[instruction.a], memory[instruction.b]);
+                break;
+            case 0x21: // subtract
+                memory[instruction.c] = wrapping_subtract(memory[instruction.a], memory[instruction.b]);
+                break;
+            case 0x22: // multiply
+                memory[instruction.c] = wrapping_multiply(memory[instruction.a], memory[instruction.b]);
+                break;
+            case 0x24: // compare
+                memory[instruction.c] = compare_values(memory[instruction.a], memory[instruction.b]);
+                break;
+            case 0x30: // jmp
+                pc = take_branch(instruction.a) - 1; // Jump to the specified address
+                break;
+            case 0x31: // if
+                if (memory[instruction.a] != 0) {
+                    pc = take_branch(instruction.b) - 1; // Conditional jump
+                }
+                break;
+            case 0x32: // loop: taken while the count is positive, as in the other engines
+                if (memory[instruction.a] > 0) {
+                    pc = take_branch(instruction.b) - 1;
+                }
+                break;
+            case 0x33: // loop-begin
+                if (memory[instruction.a] <= 0) {
+                    pc = instruction.b; // Skip the body and its loop-end
+                } else {
+                    loop_counters[loop_depth++] = loop_counter;
+                    loop_counter = memory[instruction.a];
+                }
+                break;
+            case 0x34: // loop-end
+                if (--loop_counter > 0) {
+                    pc = instruction.a; // Back to the first body instruction
+                } else {
+                    loop_counter = loop_counters[--loop_depth];
+                }
+                break;
+            case 0x35: // switch-table
+                pc = take_branch(switch_table_target(constants + instruction.b, memory[instruction.a])) - 1;
+                break;
+            case 0x36: // switch-search
+                pc = take_branch(switch_search_target(constants + instruction.b, memory[instruction.a])) - 1;
+                break;
+            case 0x40: // print
+                std::cout << print_label << memory[instruction.a] << std::endl;
+                break;
+            case 0x70: // malloc: the block address lives in the destination slot
+                memory[instruction.c] = vm_malloc(constants[instruction.a], instruction.c);
+                break;
+            case 0x71: // free
+                vm_free(memory[instruction.a]);
+                break;
+            case 0xA0: // let + let
+                memory[instruction.a] = constants[instruction.b];
+                memory[next->a] = constants[next->b];
+                pc++;
+                break;
+            case 0xA1: // let + add
+                memory[instruction.a] = constants[instruction.b];
+                memory[next->c] = wrapping_add(memory[next->a], memory[next->b]);
+                pc++;
+                break;
+            case 0xA2: // add + jmp
+                memory[instruction.c] = wrapping_add(memory[instruction.a], memory[instruction.b]);
+                pc = take_branch(next->a) - 1;
+                break;
+            case 0xA3: // subtract + jmp
+                memory[instruction.c] = wrapping_subtract(memory[instruction.a], memory[instruction.b]);
+                pc = take_branch(next->a) - 1;
+                break;
+            case 0xA4: // multiply + jmp
+                memory[instruction.c] = wrapping_multiply(memory[instruction.a], memory[instruction.b]);
+                pc = take_branch(next->a) - 1;
+                break;
+            case 0xA5: // add + if
+                memory[instruction.c] = wrapping_add(memory[instruction.a], memory[instruction.b]);
+                pc = memory[next->a] != 0 ? take_branch(next->b) - 1 : pc + 1;
+                break;
+            case 0xA6: // subtract + if
+                memory[instruction.c] = wrapping_subtract(memory[instruction.a], memory[instruction.b]);
+                pc = memory[next->a] != 0 ? take_branch(next->b) - 1 : pc + 1;
+                break;
+            default:
+                std::cerr << "Unknown opcode: 0x" << std::hex << (int)instruction.opcode << std::endl;
+                exit(1);
+        }
+        pc++;
+    }
+    program_counter = pc;
+}
+
+#if CONTOUR_THREADED_DISPATCH
+// Direct-threaded engine: every handler ends in its own indirect jump to the next one
+void execute_binary_program_threaded() {
+    void *dispatch_table[256];
+    for (void *&entry : dispatch_table) entry = &&op_unknown;
+    dispatch_table[0x10] = &&op_let;
+    dispatch_table[0x20] = &&op_add;
+    dispatch_table[0x21] = &&op_subtract;
+    dispatch_table[0x22] = &&op_multiply;
+    dispatch_table[0x24] = &&op_compare;
+    dispatch_table[0x30] = &&op_jump;
+    dispatch_table[0x31] = &&op_if;
+    dispatch_table[0x32] = &&op_loop;
+    dispatch_table[0x33] = &&op_loop_begin;
+    dispatch_table[0x34] = &&op_loop_end;
+    dispatch_table[0x35] = &&op_switch_table;
+    dispatch_table[0x36] = &&op_switch_search;
+    dispatch_table[0x40] = &&op_print;
+    dispatch_table[0x70] = &&op_malloc;
+    dispatch_table[0x71] = &&op_free;
+    dispatch_table[0xA0] = &&op_let_let;
+    dispatch_table[0xA1] = &&op_let_add;
+    dispatch_table[0xA2] = &&op_add_jump;
+    dispatch_table[0xA3] = &&op_subtract_jump;
+    dispatch_table[0xA4] = &&op_multiply_jump;
+    dispatch_table[0xA5] = &&op_add_if;
+    dispatch_table[0xA6] = &&op_subtract_if;
+
+    const Instruction *code = active_program.code;
+    const size_t program_size = active_program.size;
+    const int64_t *constants = active_program.constants;
+    size_t pc = program_counter;
+    const Instruction *instruction = nullptr;
+    int64_t loop_counter = 0;
+    int64_t loop_counters[MAX_LOOP_DEPTH];
+    size_t loop_depth = 0;
+
+#define DISPATCH()                                       \
+    do {                                                 \
+        if (pc >= program_size) goto halt;               \
+        instruction = &code[pc];                         \
+        goto *dispatch_table[instruction->opcode];       \
+    } while (0)
+#define NEXT() do { pc++; DISPATCH(); } while (0)
+
+    DISPATCH();
+
+op_let:
+    memory[instruction->a] = constants[instruction->b];
+    NEXT();
+op_add:
+    memory[instruction->c] = wrapping_add(memory[instruction->a], memory[instruction->b]);
+    NEXT();
+op_subtract:
+    memory[instruction->c] = wrapping_subtract(memory[instruction->a], memory[instruction->b]);
+    NEXT();
+op_multiply:
+    memory[instruction->c] = wrapping_multiply(memory[instruction->a], memory[instruction->b]);
+    NEXT();
+op_compare:
+    memory[instruction->c] = compare_values(memory[instruction->a], memory[instruction->b]);
+    NEXT();
+op_jump:
+    pc = take_branch(instruction->a);
+    DISPATCH();
+op_if:
+    if (memory[instruction->a] != 0) {
+        pc = take_branch(instruction->b);
+        DISPATCH();
+    }
+    NEXT();
+op_loop:
+    if (memory[instruction->a] > 0) {
+        pc = take_branch(instruction->b);
+        DISPATCH();
+    }
+    NEXT();
+op_loop_begin:
+    if (memory[instruction->a] <= 0) {
+        pc = static_cast<size_t>(instruction->b) + 1;
+        DISPATCH();
+    }
+    loop_counters[loop_depth++] = loop_counter;
+    loop_counter = memory[instruction->a];
+    NEXT();
+op_loop_end:
+    if (--loop_counter > 0) {
+        pc = static_cast<size_t>(instruction->a) + 1;
+        DISPATCH();
+    }
+    loop_counter = loop_counters[--loop_depth];
+    NEXT();
+op_switch_table:
+    pc = take_branch(switch_table_target(constants + instruction->b, memory[instruction->a]));
+    DISPATCH();
+op_switch_search:
+    pc = take_branch(switch_search_target(constants + instruction->b, memory[instruction->a]));
+    DISPATCH();
+op_print:
+    std::cout << print_label << memory[instruction->a] << std::endl;
+    NEXT();
+op_malloc:
+    memory[instruction->c] = vm_malloc(constants[instruction->a], instruction->c);
+    NEXT();
+op_free:
+    vm_free(memory[instruction->a]);
+    NEXT();
+op_let_let:
+    memory[instruction->a] = constants[instruction->b];
+    memory[instruction[1].a] = constants[instruction[1].b];
+    pc += 2;
+    DISPATCH();
+op_let_add:
+    memory[instruction->a] = constants[instruction->b];
+    memory[instruction[1].c] = memory[instruction[1].a] + memory[instruction[1].b];
+    pc += 2;
+    DISPATCH();
+op_add_jump:
+    memory[instruction->c] = wrapping_add(memory[instruction->a], memory[instruction->b]);
+    pc = take_branch(instruction[1].a);
+    DISPATCH();
+op_subtract_jump:
+    memory[instruction->c] = wrapping_subtract(memory[instruction->a], memory[instruction->b]);
+    pc = take_branch(instruction[1].a);
+    DISPATCH();
+op_multiply_jump:
+    memory[instruction->c] = wrapping_multiply(memory[instruction->a], memory[instruction->b]);
+    pc = take_branch(instruction[1].a);
+    DISPATCH();
+op_add_if:
+    memory[instruction->c] = wrapping_add(memory[instruction->a], memory[instruction->b]);
+    pc = memory[instruction[1].a] != 0 ? take_branch(instruction[1].b) : pc + 2;
+    DISPATCH();
+op_subtract_if:
+    memory[instruction->c] = wrapping_subtract(memory[instruction->a], memory[instruction->b]);
+    pc = memory[instruction[1].a] != 0 ? take_branch(instruction[1].b) : pc + 2;
+    DISPATCH();
+op_unknown:
+    std::cerr << "Unknown opcode: 0x" << std::hex << (int)instruction->opcode << std::endl;
+    exit(1);
+
+#undef NEXT
+#undef DISPATCH
+halt:
+    program_counter = pc;
+}
+#endif
+
+// Register tier: three-address code over a per-frame register file. Memory slots are
+// loaded into registers once on entry and written back on halt, so the body never does
+// a memory round trip for an allocated slot.
+enum RegisterOp : uint8_t {
+    R_LOADK,       // dst = constants[imm]
+    R_LOAD,        // dst = memory[imm]
+    R_STORE,       // memory[imm] = src1
+    R_ADD,         // dst = src1 + src2
+    R_SUB,         // dst = src1 - src2
+    R_MUL,         // dst = src1 * src2
+    R_CMP,         // dst = -1, 0 or 1 as src1 is below, equal to or above src2
+    R_JMP,         // pc = imm
+    R_JNZ,         // if (src1 != 0) pc = imm
+    R_JGZ,         // if (src1 > 0) pc = imm
+    R_LOOP_BEGIN,  // counted loop over src1 iterations, imm = pc past the loop
+    R_LOOP_END,    // imm = first body pc
+    R_SWITCH_TABLE,   // pc = dense table at tables[imm] indexed by src1
+    R_SWITCH_SEARCH,  // pc = search table at tables[imm] looked up by src1
+    R_PRINT,       // print src1
+    R_MALLOC,      // dst = malloc of the block described by mallocs[imm]
+    R_FREE,        // free(src1)
+    R_HALT         // write allocated registers back to memory and stop
+};
+
+struct RegisterInstruction {
+    uint8_t op;
+    uint8_t dst;
+    uint8_t src1;
+    uint8_t src2;
+    int32_t imm;
+};
+static_assert(sizeof(RegisterInstruction) == 8, "RegisterInstruction must stay 8 bytes");
+
+const size_t ALLOCATABLE_REGISTERS = 32;
+const size_t SCRATCH_REGISTER = ALLOCATABLE_REGISTERS;   // Three scratch registers for spilled slots
+const size_t REGISTER_FILE_SIZE = ALLOCATABLE_REGISTERS + 3;
+
+struct RegisterProgram {
+    std::vector<RegisterInstruction> code;
+    std::vector<std::pair<int32_t, uint8_t>> bindings;   // memory slot -> register
+    std::vector<int64_t> tables;                         // Switch tables with register-program targets
+    std::vector<std::pair<int32_t, int32_t>> mallocs;    // Size constant, destination slot
+};
+
+// Translate the verified slot program. Slots are ranked by use count weighted by loop
+// depth and the hottest ALLOCATABLE_REGISTERS get registers; the rest are spilled through
+// scratch registers with explicit loads and stores.
+RegisterProgram translate_to_registers() {
+    const Instruction *code = active_program.code;
+    const size_t program_size = active_program.size;
+
+    // Loop depth per instruction: counted loop bodies and backward branch ranges
+    std::vector<int> depth_delta(program_size + 1, 0);
+    for (size_t pc = 0; pc < program_size; ++pc) {
+        uint8_t opcode = base_opcode_of(code[pc]);
+        int64_t target = opcode == 0x30 ? code[pc].a : (opcode == 0x31 || opcode == 0x32) ? code[pc].b : -1;
+        if (opcode == 0x34) target = code[pc].a;
+        if (target >= 0 && static_cast<size_t>(target) <= pc) {
+            depth_delta[target]++;
+            depth_delta[pc + 1]--;
+        }
+    }
+    std::unordered_map<int32_t, uint64_t> slot_weight;
+    int depth = 0;
+    for (size_t pc = 0; pc < program_size; ++pc) {
+        depth += depth_delta[pc];
+        uint64_t weight = uint64_t(1) << (3 * std::min(depth, 6));
+        const Instruction &instruction = code[pc];
+        switch (base_opcode_of(instruction)) {
+            case 0x10: slot_weight[instruction.a] += weight; break;
+            case 0x20: case 0x21: case 0x22: case 0x24:
+                slot_weight[instruction.a] += weight;
+                slot_weight[instruction.b] += weight;
+                slot_weight[instruction.c] += weight;
+                break;
+            case 0x31: case 0x32: case 0x33: case 0x35: case 0x36: case 0x40: case 0x71:
+                slot_weight[instruction.a] += weight;
+                break;
+            case 0x70: slot_weight[instruction.c] += weight; break;
+            default: break;
+        }
+    }
+
+    std::vector<std::pair<uint64_t, int32_t>> ranked;
+    for (const auto &entry : slot_weight) ranked.push_back({entry.second, entry.first});
+    std::sort(ranked.begin(), ranked.end(), [](const auto &x, const auto &y) {
+        return x.first != y.first ? x.first > y.first : x.second < y.second;
+    });
+
+    RegisterProgram program;
+    std::unordered_map<int32_t, uint8_t> register_of;
+    for (size_t i = 0; i < ranked.size() && i < ALLOCATABLE_REGISTERS; ++i) {
+        register_of[ranked[i].second] = static_cast<uint8_t>(i);
+        program.bindings.push_back({ranked[i].second, static_cast<uint8_t>(i)});
+    }
+
+    auto emit = [&](uint8_t op, uint8_t dst, uint8_t src1, uint8_t src2, int32_t imm) {
+        program.code.push_back({op, dst, src1, src2, imm});
+    };
+    // Register holding a slot for reading, loading spilled slots into the given scratch register
+    auto read_slot = [&](int32_t slot, size_t scratch) -> uint8_t {
+        auto it = register_of.find(slot);
+        if (it != register_of.end()) return it->second;
+        emit(R_LOAD, static_cast<uint8_t>(SCRATCH_REGISTER + scratch), 0, 0, slot);
+        return static_cast<uint8_t>(SCRATCH_REGISTER + scratch);
+    };
+    auto write_register = [&](int32_t slot) -> uint8_t {
+        auto it = register_of.find(slot);
+        return it != register_of.end() ? it->second : static_cast<uint8_t>(SCRATCH_REGISTER + 2);
+    };
+    auto spill_if_needed = [&](int32_t slot) {
+        if (!register_of.count(slot)) emit(R_STORE, 0, static_cast<uint8_t>(SCRATCH_REGISTER + 2), 0, slot);
+    };
+
+    for (const auto &binding : program.bindings) emit(R_LOAD, binding.second, 0, 0, binding.first);
+
+    // Branch targets are patched once every instruction's start is known
+    std::vector<int32_t> start_of(program_size + 1, 0);
+    std::vector<std::pair<size_t, size_t>> fixups;   // register pc, slot-program pc
+    std::vector<size_t> table_fixups;                // Positions in tables holding slot-program pcs
+    for (size_t pc = 0; pc < program_size; ++pc) {
+        const Instruction &instruction = code[pc];
+        start_of[pc] = static_cast<int32_t>(program.code.size());
+        switch (base_opcode_of(instruction)) {
+            case 0x10: // let
+                emit(R_LOADK, write_register(instruction.a), 0, 0, instruction.b);
+                spill_if_needed(instruction.a);
+                break;
+            case 0x20: case 0x21: case 0x22: case 0x24: { // arithmetic, compare
+                uint8_t left = read_slot(instruction.a, 0);
+                uint8_t right = read_slot(instruction.b, 1);
+                const uint8_t opcode = base_opcode_of(instruction);
+                uint8_t op = opcode == 0x20 ? R_ADD : opcode == 0x21 ? R_SUB : opcode == 0x22 ? R_MUL : R_CMP;
+                emit(op, write_register(instruction.c), left, right, 0);
+                spill_if_needed(instruction.c);
+                break;
+            }
+            case 0x30: // jmp
+                fixups.push_back({program.code.size(), static_cast<size_t>(instruction.a)});
+                emit(R_JMP, 0, 0, 0, 0);
+                break;
+            case 0x31: case 0x32: { // if, loop
+                uint8_t condition = read_slot(instruction.a, 0);
+                fixups.push_back({program.code.size(), static_cast<size_t>(instruction.b)});
+                emit(base_opcode_of(instruction) == 0x31 ? R_JNZ : R_JGZ, 0, condition, 0, 0);
+                break;
+            }
+            case 0x33: { // loop-begin: skip to the instruction after its loop-end
+                uint8_t count = read_slot(instruction.a, 0);
+                fixups.push_back({program.code.size(), static_cast<size_t>(instruction.b) + 1});
+                emit(R_LOOP_BEGIN, 0, count, 0, 0);
+                break;
+            }
+            case 0x34: // loop-end: back to the first body instruction
+                fixups.push_back({program.code.size(), static_cast<size_t>(instruction.a) + 1});
+                emit(R_LOOP_END, 0, 0, 0, 0);
+                break;
+            case 0x35: case 0x36: { // switch-table, switch-search: copy the table, targets patched below
+                const bool dense = base_opcode_of(instruction) == 0x35;
+                const int64_t *table = active_program.constants + instruction.b;
+                const size_t header = dense ? 3 : 2;
+                const int64_t count = table[dense ? 1 : 0];
+                const size_t first_target = header + (dense ? 0 : count);
+                size_t offset = program.tables.size();
+                program.tables.insert(program.tables.end(), table, table + first_target + count);
+                table_fixups.push_back(offset + header - 1);   // Default target
+                for (int64_t i = 0; i < count; ++i) table_fixups.push_back(offset + first_target + i);
+                emit(dense ? R_SWITCH_TABLE : R_SWITCH_SEARCH, 0, read_slot(instruction.a, 0), 0, static_cast<int32_t>(offset));
+                break;
+            }
+            case 0x40: // print
+                emit(R_PRINT, 0, read_slot(instruction.a, 0), 0, 0);
+                break;
+            case 0x70: // malloc
+                emit(R_MALLOC, write_register(instruction.c), 0, 0, static_cast<int32_t>(program.mallocs.size()));
+                program.mallocs.push_back({instruction.a, instruction.c});
+                spill_if_needed(instruction.c);
+                break;
+            case 0x71: // free
+                emit(R_FREE, 0, read_slot(instruction.a, 0), 0, 0);
+                break;
+        }
+    }
+    start_of[program_size] = static_cast<int32_t>(program.code.size());
+    emit(R_HALT, 0, 0, 0, 0);
+
+    for (const auto &fixup : fixups) program.code[fixup.first].imm = start_of[fixup.second];
+    for (size_t position : table_fixups) program.tables[position] = start_of[program.tables[position]];
+    return program;
+}
+
+void execute_register_program(const RegisterProgram &program) {
+    const RegisterInstruction *code = program.code.data();
+    const int64_t *constants = active_program.constants;
+    const int64_t *tables = program.tables.data();
+    int64_t *slots = memory.data();
+    int64_t registers[REGISTER_FILE_SIZE] = {};
+    int64_t loop_counter = 0;
+    int64_t loop_counters[MAX_LOOP_DEPTH];
+    size_t loop_depth = 0;
+    size_t pc = 0;
+
+    while (true) {
+        const RegisterInstruction &instruction = code[pc++];
+        switch (instruction.op) {
+            case R_LOADK: registers[instruction.dst] = constants[instruction.imm]; break;
+            case R_LOAD: registers[instruction.dst] = slots[instruction.imm]; break;
+            case R_STORE: slots[instruction.imm] = registers[instruction.src1]; break;
+            case R_ADD: registers[instruction.dst] = wrapping_add(registers[instruction.src1], registers[instruction.src2]); break;
+            case R_SUB: registers[instruction.dst] = wrapping_subtract(registers[instruction.src1], registers[instruction.src2]); break;
+            case R_MUL: registers[instruction.dst] = wrapping_multiply(registers[instruction.src1], registers[instruction.src2]); break;
+            case R_CMP: registers[instruction.dst] = compare_values(registers[instruction.src1], registers[instruction.src2]); break;
+            case R_JMP: pc = instruction.imm; break;
+            case R_JNZ: if (registers[instruction.src1] != 0) pc = instruction.imm; break;
+            case R_JGZ: if (registers[instruction.src1] > 0) pc = instruction.imm; break;
+            case R_LOOP_BEGIN:
+                if (registers[instruction.src1] <= 0) {
+                    pc = instruction.imm;
+                } else {
+                    loop_counters[loop_depth++] = loop_counter;
+                    loop_counter = registers[instruction.src1];
+                }
+                break;
+            case R_LOOP_END:
+                if (--loop_counter > 0) {
+                    pc = instruction.imm;
+                } else {
+                    loop_counter = loop_counters[--loop_depth];
+                }
+                break;
+            case R_SWITCH_TABLE:
+                pc = switch_table_target(tables + instruction.imm, registers[instruction.src1]);
+                break;
+            case R_SWITCH_SEARCH:
+                pc = switch_search_target(tables + instruction.imm, registers[instruction.src1]);
+                break;
+            case R_PRINT:
+                std::cout << print_label << registers[instruction.src1] << std::endl;
+                break;
+            case R_MALLOC:
+                registers[instruction.dst] = vm_malloc(constants[program.mallocs[instruction.imm].first],
+                                                       program.mallocs[instruction.imm].second);
+                break;
+            case R_FREE:
+                vm_free(registers[instruction.src1]);
+                break;
+            case R_HALT:
+                for (const auto &binding : program.bindings) slots[binding.first] = registers[binding.second];
+                program_counter = active_program.size;
+                return;
+        }
+    }
+}
+
+// CONTOUR_FUSION=off disables the default superinstruction pass
+bool fusion_enabled = true;
+
+void configure_fusion_from_env() {
+    const char *mode = std::getenv("CONTOUR_FUSION");
+    if (mode && std::string(mode) == "off") fusion_enabled = false;
+}
+
+// Arm the JIT counters for a verified program
+void prepare_jit() {
+    jit_reset();
+    if (!jit_enabled || !CONTOUR_JIT) return;
+    block_counters.assign(active_program.size, 0);
+    jit_blocks.assign(active_program.size, nullptr);
+    jit_active = true;
+}
+
+// Register translation of the loaded program, made on its first register-tier run.
+// It reads base opcodes only, so later fusion leaves it valid.
+RegisterProgram register_program;
+bool register_program_ready = false;
+
+// Verify once per load, then fuse with every available rule unless the image was
+// already fused offline (see --fuse-profile)
+void prepare_binary_program() {
+    verify_binary_program();
+    prepare_jit();
+    register_program_ready = false;
+    for (size_t pc = 0; pc < active_program.size; ++pc) {
+        if (is_fused_opcode(active_program.code[pc].opcode)) return;
+    }
+    if (fusion_enabled) fuse_superinstructions(default_fusion_set());
+}
+
+// Execute the binary program with control structures
+void execute_binary_program() {
+    if (!program_verified) prepare_binary_program();
+    // Register programs always start from the top; resuming mid-program takes the
+    // stack engines
+    if (dispatch_mode == DispatchMode::Register && !profile_dispatch && program_counter == 0) {
+        if (!register_program_ready) {
+            register_program = translate_to_registers();
+            register_program_ready = true;
+        }
+        execute_register_program(register_program);
+        return;
+    }
+#if CONTOUR_THREADED_DISPATCH
+    if (dispatch_mode == DispatchMode::Threaded && !profile_dispatch) {
+        execute_binary_program_threaded();
+        return;
+    }
+#endif
+    execute_binary_program_switch();
+}
+
+// AST Interpreter with loop and condition nodes
+class AOTInterpreter {
+private:
+    struct Node {
+        std::string command;
+        Node *left;
+        Node *right;
+    };
+
+    std::vector<Node *> garbageCollection;
+
+    Node *create_node(const std::string &command) {
+        Node *node = new Node();
+        node->command = command;
+        node->left = nullptr;
+        node->right = nullptr;
+        return node;
+    }
+
+    void execute_tree(Node *root) {
+        if (!root) return;
+
+        if (root->command == "IF") {
+            std::cout << "Evaluating IF condition\n";
+            execute_tree(root->left);  // Evaluate left child as condition
+            if (rand() % 2) execute_tree(root->right);  // Simulate condition outcome
+        } else if (root->command == "LOOP") {
+            std::cout << "Executing LOOP block\n";
+            for (int i = 0; i < 3; ++i) execute_tree(root->left);  // Simulate a loop
+        } else {
+            std::cout << "Executing: " << root->command << std::endl;
+        }
+
+        garbageCollection.push_back(root);
+    }
+
+    void clean_up() {
+        for (Node *node : garbageCollection) {
+            delete node;
+        }
+        garbageCollection.clear();
+    }
+
+public:
+    void run() {
+        Node *root = create_node("IF");
+        root->left = create_node("Condition");
+        root->right = create_node("LOOP");
+        root->right->left = create_node("Loop Body");
+
+        execute_tree(root);
+        clean_up();
+    }
+};
+
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <stack>
 #include <sstream>
 #include <stdexcept>
 #include <map>
+#include <set>
+#include <algorithm>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include <charconv>
+#include <fstream>
+#include <cstdio>
+
+// The AST VM below shares the bytecode VM's memory, compiler targets and engines
+using namespace std;
+
+// Memory and Stack
+vector<int64_t> global_memory(256, 0);  // Global memory
+
+// Call stack: every frame is a contiguous run of slots in one growable array. Variable
+// names are resolved to slot indices at parse time, so an access is base + index and a
+// call only grows the array (which keeps its capacity across calls).
+struct CallStack {
+    vector<int64_t> slots;
+    vector<size_t> frame_bases;
+
+    int64_t& operator[](int32_t slot) { return slots[frame_bases.back() + slot]; }
+
+    void push_frame(size_t size) {
+        frame_bases.push_back(slots.size());
+        slots.resize(slots.size() + size, 0);
+    }
+
+    void pop_frame() {
+        slots.resize(frame_bases.back());
+        frame_bases.pop_back();
+    }
+};
+CallStack call_stack;  // Stack for function calls and local variables
+
+// Frame layout built while parsing: variable name -> slot index within its frame
+struct FrameLayout {
+    unordered_map<int64_t, int32_t> slots;
+
+    int32_t slot_for(int64_t name) {
+        auto it = slots.find(name);
+        if (it != slots.end()) return it->second;
+        int32_t slot = static_cast<int32_t>(slots.size());
+        slots[name] = slot;
+        return slot;
+    }
+
+    size_t size() const { return slots.size(); }
+};
+FrameLayout global_layout;  // Top-level frame, shared by every REPL line
+
+// Ranges of top-level FOR loops that have run, first -> last, disjoint. A FOR stores
+// only the counters its frame has slots for; a variable of a covered range that a later
+// line names for the first time starts out with the value that FOR gave it.
+map<int64_t, int64_t> covered_for_ranges;
+
+void cover_for_range(int64_t first, int64_t last) {
+    auto it = covered_for_ranges.upper_bound(first);
+    if (it != covered_for_ranges.begin() && prev(it)->second >= first) {
+        --it;
+        first = it->first;
+        last = max(last, it->second);
+    }
+    auto end = covered_for_ranges.upper_bound(last);
+    for (it = covered_for_ranges.lower_bound(first); it != end;) {
+        last = max(last, it->second);
+        it = covered_for_ranges.erase(it);
+    }
+    covered_for_ranges[first] = last;
+}
+
+// Value of a global variable that has never been stored
+int64_t initial_global_value(int64_t name) {
+    auto it = covered_for_ranges.upper_bound(name);
+    return it != covered_for_ranges.begin() && prev(it)->second >= name ? name : 0;
+}
+
+// Calls are limited by the memory the frame and continuation stacks would use, not by
+// a fixed depth; CONTOUR_STACK_LIMIT overrides it (bytes, or with a K/M/G suffix)
+size_t max_call_stack_bytes = size_t(64) << 20;
+int max_inline_depth = 50;  // Nested calls the bytecode compiler will inline
+
+void configure_call_stack_from_env() {
+    const char* limit = getenv("CONTOUR_STACK_LIMIT");
+    if (!limit) return;
+    char* suffix = nullptr;
+    unsigned long long bytes = strtoull(limit, &suffix, 10);
+    switch (suffix ? *suffix : '\0') {
+    case 'G': case 'g': bytes <<= 10; // fall through
+    case 'M': case 'm': bytes <<= 10; // fall through
+    case 'K': case 'k': bytes <<= 10; break;
+    default: break;
+    }
+    if (bytes > 0) max_call_stack_bytes = static_cast<size_t>(bytes);
+}
+
+// Function Table: Maps function names to their AST representations
+unordered_map<string, struct ASTNode*> function_table;
+uint32_t function_table_generation = 1;  // Bumped whenever a FUNC is (re)defined
+
+// Bump allocator owning every node of one parse. Nodes are trivially destructible, so
+// dropping the arena frees the whole tree at once.
+class ASTArena {
+public:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    bool holds_functions = false;   // function_table points into this arena
+
+    // Chunks come from operator new, so offsets aligned to at most max_align_t are enough
+    void* allocate(size_t bytes, size_t align) {
+        size_t offset = (used + align - 1) & ~(align - 1);
+        if (chunks.empty() || offset + bytes > CHUNK_SIZE) {
+            // Oversized requests get a block of their own; the current chunk stays open
+            if (bytes > CHUNK_SIZE / 4) {
+                oversized.push_back(make_unique<char[]>(bytes));
+                total += bytes;
+                return oversized.back().get();
+            }
+            chunks.push_back(make_unique<char[]>(CHUNK_SIZE));
+            total += CHUNK_SIZE;
+            offset = 0;
+        }
+        used = offset + bytes;
+        return chunks.back().get() + offset;
+    }
+
+    template <typename T>
+    T* allocate_array(size_t count) {
+        static_assert(alignof(T) <= alignof(max_align_t), "over-aligned arena type");
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    // Copy text into the arena so nodes can refer to it after the source line is gone
+    string_view intern(string_view text) {
+        if (text.empty()) return {};
+        char* copy = allocate_array<char>(text.size());
+        memcpy(copy, text.data(), text.size());
+        return string_view(copy, text.size());
+    }
+
+    size_t bytes_reserved() const { return total; }
+
+private:
+    vector<unique_ptr<char[]>> chunks;
+    vector<unique_ptr<char[]>> oversized;
+    size_t used = 0;
+    size_t total = 0;
+};
+
+// Arenas whose parse defined a function stay alive while function_table uses them
+vector<unique_ptr<ASTArena>> function_arenas;
+
+// Small vector for node fields: N elements inline, spilling into the arena when full
+template <typename T, uint32_t N>
+class ArenaVector {
+    static_assert(is_trivially_copyable<T>::value, "ArenaVector holds plain values only");
+
+public:
+    ArenaVector() {}
+
+    T* begin() { return capacity == N ? local : spilled; }
+    T* end() { return begin() + count; }
+    const T* begin() const { return capacity == N ? local : spilled; }
+    const T* end() const { return begin() + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t i) { return begin()[i]; }
+    const T& operator[](size_t i) const { return begin()[i]; }
+    void clear() { count = 0; }
+
+    // Where the elements live once spilled (nullptr while inline) and how many the
+    // storage has room for; the snapshot writer copies and relocates that storage
+    T* const* spilled_field() const { return capacity == N ? nullptr : &spilled; }
+    uint32_t storage_capacity() const { return capacity; }
+
+    void push_back(ASTArena& arena, const T& value) {
+        if (count == capacity) {
+            T* grown = arena.allocate_array<T>(capacity * 2);
+            memcpy(grown, begin(), sizeof(T) * count);
+            spilled = grown;
+            capacity *= 2;
+        }
+        begin()[count++] = value;
+    }
+
+private:
+    uint32_t count = 0;
+    uint32_t capacity = N;
+    union {
+        T local[N];
+        T* spilled;
+    };
+};
+
+// Error handling utility
+void throw_error(const string& msg) {
+    throw runtime_error("Error: " + msg);
+}
+
+// Node kinds, decided once from the command text when a node is built so execution
+// can dispatch on a jump table; the command string is kept for diagnostics
+enum class NodeKind : uint8_t {
+    Let, Add, Call, Return, While, For, Print, Func, Switch, Case, Default, Malloc, Free, Unknown,
+    // Built by the loop optimizer, never parsed
+    Block,       // Children run once
+    Preheader,   // WHILE's first child: runs on entry only, not on later passes
+    Repeat       // Children run value times
+};
+
+struct NodeKindName {
+    string_view name;
+    NodeKind kind;
+};
+
+const NodeKindName node_kind_names[] = {
+    {"LET", NodeKind::Let}, {"ADD", NodeKind::Add}, {"CALL", NodeKind::Call},
+    {"RETURN", NodeKind::Return}, {"WHILE", NodeKind::While}, {"FOR", NodeKind::For},
+    {"PRINT", NodeKind::Print}, {"FUNC", NodeKind::Func}, {"SWITCH", NodeKind::Switch}, {"MATCH", NodeKind::Switch},
+    {"CASE", NodeKind::Case}, {"DEFAULT", NodeKind::Default}, {"MALLOC", NodeKind::Malloc},
+    {"FREE", NodeKind::Free}
+};
+
+const NodeKindName* find_node_kind(string_view cmd) {
+    for (const NodeKindName& entry : node_kind_names) {
+        if (entry.name == cmd) return &entry;
+    }
+    return nullptr;
+}
+
+// Operands the tree walker reads from a node of this kind
+constexpr size_t required_operands(NodeKind kind) {
+    return kind == NodeKind::Let ? 2 : kind == NodeKind::Add ? 3 : kind == NodeKind::Print ? 1 : 0;
+}
+
+// Numeric operand of a command, stored inline in its node
+struct Operand {
+    int64_t value;   // Constant, or the name of a variable
+    int32_t slot;    // Frame slot of that variable once resolved
+};
+
+class ASTNode;
+using NodeList = ArenaVector<ASTNode*, 2>;
+
+// Arm a SWITCH dispatches to for a value, built once its arms are final: dense over
+// [min, min + count) when the CASE values are compact, else sorted keys to search
+struct SwitchTable {
+    bool dense;
+    int64_t min;
+    uint32_t count;
+    uint32_t default_arm;   // Number of arms when there is no DEFAULT
+    const int64_t* keys;    // Search tables only
+    const uint32_t* arms;
+
+    uint32_t arm_for(int64_t value) const {
+        if (dense) {
+            uint64_t index = static_cast<uint64_t>(value) - static_cast<uint64_t>(min);
+            return index < count ? arms[index] : default_arm;
+        }
+        const int64_t* found = lower_bound(keys, keys + count, value);
+        return found != keys + count && *found == value ? arms[found - keys] : default_arm;
+    }
+};
+
+// AST Node class with enhanced function-related fields. Nodes live in an ASTArena and
+// own nothing themselves: operands are inline and every list spills into the arena.
+class ASTNode {
+public:
+    string_view command;         // Source text of the command, for diagnostics
+    NodeKind kind;               // What execution dispatches on
+    bool inline_hint;            // FUNC: annotated @optimizeInline
+    int32_t slot;                // Frame slot of the variable named by value
+    int64_t value;               // For constants and loop counters
+    ASTNode* condition;          // For conditional expressions in loops and if-else statements
+    ArenaVector<Operand, 3> operands;   // LET/ADD/PRINT/MALLOC/FREE arguments, FOR: counters it stores
+    NodeList children;           // Nested commands
+    string_view function_name;   // For function nodes
+    ArenaVector<int64_t, 2> function_args;  // Function arguments
+    ArenaVector<int32_t, 2> slots;   // FUNC: parameter slots
+    uint32_t frame_size;         // FUNC: slots in the function's frame
+    uint32_t callee_generation;  // CALL: function_table_generation callee was looked up in
+    ASTNode* callee;             // CALL: cached function_table entry
+    ASTNode* inlined_from;       // CALL: function whose body children is a copy of
+    const SwitchTable* switch_table;  // SWITCH: built when slots are resolved
+
+    ASTNode(string_view cmd, NodeKind node_kind, int64_t val)
+        : command(cmd), kind(node_kind), inline_hint(false), slot(-1), value(val), condition(nullptr),
+          frame_size(0), callee_generation(0), callee(nullptr), inlined_from(nullptr), switch_table(nullptr) {}
+};
+static_assert(is_trivially_destructible<ASTNode>::value, "ASTArena never runs node destructors");
+
+ASTNode* make_node(ASTArena& arena, string_view cmd, int64_t val = 0) {
+    const NodeKindName* known = find_node_kind(cmd);
+    void* memory = arena.allocate(sizeof(ASTNode), alignof(ASTNode));
+    if (known) return new (memory) ASTNode(known->name, known->kind, val);
+    return new (memory) ASTNode(arena.intern(cmd), NodeKind::Unknown, val);
+}
+
+ASTNode* make_node(ASTArena& arena, NodeKind kind, string_view name, int64_t val = 0) {
+    return new (arena.allocate(sizeof(ASTNode), alignof(ASTNode))) ASTNode(name, kind, val);
+}
+
+// Function body a CALL refers to, or nullptr. The name is only hashed again after some
+// FUNC has been defined since the last lookup; otherwise this is two loads and a compare.
+inline ASTNode* resolve_callee(ASTNode* call) {
+    if (call->callee_generation != function_table_generation) {
+        auto it = function_table.find(string(call->function_name));
+        call->callee = it != function_table.end() ? it->second : nullptr;
+        call->callee_generation = function_table_generation;
+    }
+    return call->callee;
+}
+
+// The first CASE with a value wins; DEFAULT takes every other value
+void build_switch_table(ASTNode* node, ASTArena& arena) {
+    uint32_t arm_count = static_cast<uint32_t>(node->children.size());
+    map<int64_t, uint32_t> cases;
+    uint32_t default_arm = arm_count;
+    for (uint32_t i = 0; i < arm_count; ++i) {
+        ASTNode* arm = node->children[i];
+        if (arm->kind == NodeKind::Case) cases.emplace(arm->value, i);
+        else if (arm->kind == NodeKind::Default && default_arm == arm_count) default_arm = i;
+    }
+    SwitchTable* table = new (arena.allocate(sizeof(SwitchTable), alignof(SwitchTable))) SwitchTable{};
+    table->default_arm = default_arm;
+    table->dense = cases.empty() || switch_values_are_dense(cases.begin()->first, cases.rbegin()->first, cases.size());
+    if (table->dense) {
+        table->min = cases.empty() ? 0 : cases.begin()->first;
+        table->count = cases.empty() ? 0 : static_cast<uint32_t>(cases.rbegin()->first - table->min + 1);
+        uint32_t* arms = arena.allocate_array<uint32_t>(table->count);
+        fill(arms, arms + table->count, default_arm);
+        for (const auto& entry : cases) arms[entry.first - table->min] = entry.second;
+        table->arms = arms;
+    } else {
+        table->count = static_cast<uint32_t>(cases.size());
+        int64_t* keys = arena.allocate_array<int64_t>(table->count);
+        uint32_t* arms = arena.allocate_array<uint32_t>(table->count);
+        size_t i = 0;
+        for (const auto& entry : cases) {
+            keys[i] = entry.first;
+            arms[i++] = entry.second;
+        }
+        table->keys = keys;
+        table->arms = arms;
+    }
+    node->switch_table = table;
+}
+
+// Assign frame slots to every variable a node names. FUNC bodies are resolved against
+// their own layout when their definition is parsed; CALL arguments are literal values.
+void resolve_slots(ASTNode* node, FrameLayout& layout, ASTArena& arena) {
+    if (!node) return;
+    switch (node->kind) {
+    case NodeKind::Let:
+    case NodeKind::Print:
+        if (!node->operands.empty()) node->operands[0].slot = layout.slot_for(node->operands[0].value);
+        break;
+    case NodeKind::Add:
+        for (Operand& operand : node->operands) operand.slot = layout.slot_for(operand.value);
+        break;
+    case NodeKind::Return:
+        node->slot = layout.slot_for(node->value);
+        break;
+    case NodeKind::While:
+        if (node->condition) node->condition->slot = layout.slot_for(node->condition->value);
+        for (ASTNode* child : node->children) resolve_slots(child, layout, arena);
+        break;
+    case NodeKind::For:   // Counters are picked by resolve_for_counters
+    case NodeKind::Call:  // An inlined body runs in the caller's frame; CALL arguments are values
+    case NodeKind::Block: case NodeKind::Preheader: case NodeKind::Repeat:
+        for (ASTNode* child : node->children) resolve_slots(child, layout, arena);
+        break;
+    case NodeKind::Switch:
+        node->slot = layout.slot_for(node->value);
+        for (ASTNode* arm : node->children) {
+            for (ASTNode* child : arm->children) resolve_slots(child, layout, arena);
+        }
+        build_switch_table(node, arena);
+        break;
+    default:
+        break;   // FUNC bodies have their own frame
+    }
+}
+
+// FOR stores each pass's counter into the variable of that name, but only a name the
+// frame has a slot for can be read back. Once the whole frame is resolved, those names
+// in the range become the FOR's operands, ascending; the rest of the range costs nothing.
+void resolve_for_counters(ASTNode* node, const FrameLayout& layout, ASTArena& arena) {
+    if (node->kind == NodeKind::Func) return;
+    if (node->kind == NodeKind::For && node->condition) {
+        vector<pair<int64_t, int32_t>> counters;
+        for (const auto& entry : layout.slots) {
+            if (entry.first >= node->value && entry.first <= node->condition->value) counters.push_back(entry);
+        }
+        sort(counters.begin(), counters.end());
+        node->operands.clear();
+        for (const auto& counter : counters) node->operands.push_back(arena, Operand{counter.first, counter.second});
+    }
+    for (ASTNode* child : node->children) resolve_for_counters(child, layout, arena);
+}
+
+void resolve_function_frame(ASTNode* func, ASTArena& arena) {
+    FrameLayout layout;
+    func->slots.clear();
+    for (int64_t param : func->function_args) func->slots.push_back(arena, layout.slot_for(param));
+    for (ASTNode* child : func->children) resolve_slots(child, layout, arena);
+    for (ASTNode* child : func->children) resolve_for_counters(child, layout, arena);
+    func->frame_size = static_cast<uint32_t>(layout.size());
+}
+
+// Variables a node reads, including nested bodies but not callees (own frame)
+void collect_reads(ASTNode* node, set<int64_t>& names) {
+    switch (node->kind) {
+    case NodeKind::Add:
+        if (node->operands.size() >= 2) {
+            names.insert(node->operands[0].value);
+            names.insert(node->operands[1].value);
+        }
+        break;
+    case NodeKind::Print: case NodeKind::Free:
+        if (!node->operands.empty()) names.insert(node->operands[0].value);
+        break;
+    case NodeKind::While:
+        if (node->condition) names.insert(node->condition->value);
+        break;
+    case NodeKind::Switch:
+        names.insert(node->value);
+        break;
+    default:
+        break;
+    }
+    if (node->kind == NodeKind::Func || node->kind == NodeKind::Call) return;
+    for (ASTNode* child : node->children) collect_reads(child, names);
+}
+
+// Deep copy of a subtree into arena, with slots left for the new site to resolve
+ASTNode* copy_ast(const ASTNode* node, ASTArena& arena) {
+    void* memory = arena.allocate(sizeof(ASTNode), alignof(ASTNode));
+    ASTNode* copy = new (memory) ASTNode(node->command, node->kind, node->value);
+    copy->function_name = node->function_name;
+    copy->inlined_from = node->inlined_from;
+    for (int64_t arg : node->function_args) copy->function_args.push_back(arena, arg);
+    for (const Operand& operand : node->operands) copy->operands.push_back(arena, Operand{operand.value, -1});
+    if (node->condition) copy->condition = copy_ast(node->condition, arena);
+    for (ASTNode* child : node->children) copy->children.push_back(arena, copy_ast(child, arena));
+    return copy;
+}
+
+// AST optimizer, run on each parse before slots are resolved: propagates and folds
+// constants, drops loops and SWITCH arms whose conditions are known, and removes
+// stores that are overwritten or die before anything reads them
+bool ast_optimizer_enabled = true;
+
+void configure_ast_optimizer_from_env() {
+    const char* mode = getenv("CONTOUR_AST_OPT");
+    if (mode && string(mode) == "off") ast_optimizer_enabled = false;
+}
+
+class ASTOptimizer {
+public:
+    explicit ASTOptimizer(ASTArena& arena) : arena(arena) {}
+
+    // Top-level code: globals are unknown on entry and later lines may read any of them
+    void optimize_program(ASTNode* root) {
+        Constants known;
+        fold_nested(root, known);
+        sweep_nested(root);
+    }
+
+    // A function body starts from a zeroed frame and its locals die when it returns
+    void optimize_function(ASTNode* func) {
+        Constants known;
+        set<int64_t> names;
+        for (ASTNode* child : func->children) collect_reads(child, names);
+        for (int64_t name : names) known[name] = 0;
+        for (int64_t param : func->function_args) known.erase(param);
+        func->children = fold_block(func->children, known);
+        Liveness live{true, {}};
+        func->children = sweep_block(func->children, live);
+    }
+
+private:
+    using Constants = map<int64_t, int64_t>;   // Variables whose value is known here
+
+    // Dead variables: everything except marked when rest_dead, otherwise only marked
+    struct Liveness {
+        bool rest_dead;
+        set<int64_t> marked;
+
+        bool dead(int64_t name) const { return rest_dead != (marked.count(name) != 0); }
+        void kill(int64_t name) { rest_dead ? (void)marked.erase(name) : (void)marked.insert(name); }
+        void use(int64_t name) { rest_dead ? (void)marked.insert(name) : (void)marked.erase(name); }
+    };
+
+    ASTArena& arena;
+
+    // Forget what is known about every variable a node may write
+    static void forget_writes(ASTNode* node, Constants& known) {
+        switch (node->kind) {
+        case NodeKind::Let:
+            if (!node->operands.empty()) known.erase(node->operands[0].value);
+            break;
+        case NodeKind::Add:
+            if (node->operands.size() >= 3) known.erase(node->operands[2].value);
+            break;
+        case NodeKind::Malloc:
+            if (node->operands.size() >= 2) known.erase(node->operands[1].value);
+            break;
+        case NodeKind::Return:
+            known.erase(node->value);
+            break;
+        case NodeKind::For:
+            if (node->condition)
+                known.erase(known.lower_bound(node->value), known.upper_bound(node->condition->value));
+            break;
+        default:
+            break;
+        }
+        if (node->kind == NodeKind::Func || node->kind == NodeKind::Call) return;
+        for (ASTNode* child : node->children) forget_writes(child, known);
+    }
+
+    void fold_nested(ASTNode* node, Constants& known) {
+        Constants entry = known;
+        forget_writes(node, entry);
+        if (node->kind == NodeKind::While || node->kind == NodeKind::For || node->kind == NodeKind::Repeat)
+            node->children = fold_block(node->children, entry);
+    }
+
+    NodeList fold_block(const NodeList& nodes, Constants& known) {
+        NodeList folded;
+        for (ASTNode* node : nodes) fold_node(node, known, folded);
+        return folded;
+    }
+
+    void fold_node(ASTNode* node, Constants& known, NodeList& out) {
+        switch (node->kind) {
+        case NodeKind::Let:
+            if (node->operands.size() >= 2) known[node->operands[0].value] = node->operands[1].value;
+            break;
+        case NodeKind::Return:
+            known[node->value] = node->value;
+            break;
+        case NodeKind::Add: {
+            if (node->operands.size() < 3) break;
+            int64_t target = node->operands[2].value;
+            auto lhs = known.find(node->operands[0].value), rhs = known.find(node->operands[1].value);
+            if (lhs == known.end() || rhs == known.end()) {
+                known.erase(target);
+                break;
+            }
+            // Both inputs are known: ADD a b c becomes LET c (a + b), wrapping like the VM
+            int64_t sum = static_cast<int64_t>(static_cast<uint64_t>(lhs->second) + static_cast<uint64_t>(rhs->second));
+            node->kind = NodeKind::Let;
+            node->command = "LET";
+            node->operands.clear();
+            node->operands.push_back(arena, Operand{target, -1});
+            node->operands.push_back(arena, Operand{sum, -1});
+            known[target] = sum;
+            break;
+        }
+        case NodeKind::Malloc:
+            if (node->operands.size() >= 2) known.erase(node->operands[1].value);
+            break;
+        case NodeKind::Call:
+            // An inlined body initialises every variable it uses, all private to it
+            if (!node->children.empty()) {
+                Constants body_known;
+                node->children = fold_block(node->children, body_known);
+                Liveness body_live{true, {}};
+                node->children = sweep_block(node->children, body_live);
+            }
+            break;
+        case NodeKind::While: {
+            if (!node->condition) break;
+            auto condition = known.find(node->condition->value);
+            if (condition != known.end() && condition->second == 0) return;   // Never entered
+            fold_nested(node, known);
+            forget_writes(node, known);
+            known[node->condition->value] = 0;   // The loop only exits once it reads zero
+            break;
+        }
+        case NodeKind::For:
+            if (!node->condition) break;
+            if (node->condition->value < node->value) return;   // Empty range
+            fold_nested(node, known);
+            forget_writes(node, known);
+            break;
+        case NodeKind::Repeat:
+            if (node->value <= 0) return;
+            fold_nested(node, known);
+            forget_writes(node, known);
+            break;
+        case NodeKind::Block: case NodeKind::Preheader:
+            // Straight-line; a preheader's targets are written nowhere else in its loop
+            node->children = fold_block(node->children, known);
+            break;
+        case NodeKind::Switch: {
+            auto subject = known.find(node->value);
+            if (subject != known.end()) {
+                // Splice in the one arm that can run
+                ASTNode* arm = nullptr;
+                for (ASTNode* child : node->children) {
+                    if (child->kind == NodeKind::Case && child->value == subject->second) { arm = child; break; }
+                }
+                for (ASTNode* child : node->children) {
+                    if (!arm && child->kind == NodeKind::Default) arm = child;
+                }
+                if (arm) {
+                    for (ASTNode* child : arm->children) fold_node(child, known, out);
+                }
+                return;
+            }
+            // Later CASEs repeating an earlier value can never match
+            NodeList arms;
+            set<int64_t> seen;
+            for (ASTNode* child : node->children) {
+                if (child->kind == NodeKind::Case && !seen.insert(child->value).second) continue;
+                Constants arm_known = known;
+                child->children = fold_block(child->children, arm_known);
+                arms.push_back(arena, child);
+            }
+            node->children = arms;
+            forget_writes(node, known);
+            break;
+        }
+        default:
+            break;
+        }
+        out.push_back(arena, node);
+    }
+
+    // Nested bodies may run again, so nothing is dead at their end
+    void sweep_nested(ASTNode* node) {
+        if (node->kind == NodeKind::While || node->kind == NodeKind::For || node->kind == NodeKind::Repeat ||
+            node->kind == NodeKind::Preheader) {
+            Liveness body{false, {}};
+            node->children = sweep_block(node->children, body);
+        }
+    }
+
+    NodeList sweep_block(const NodeList& nodes, Liveness& live) {
+        vector<ASTNode*> kept;
+        for (size_t i = nodes.size(); i-- > 0;) {
+            ASTNode* node = nodes[i];
+            if (!sweep_node(node, live)) continue;
+            kept.push_back(node);
+        }
+        NodeList swept;
+        for (size_t i = kept.size(); i-- > 0;) swept.push_back(arena, kept[i]);
+        return swept;
+    }
+
+    // Update liveness backwards across node; false when node is a dead store
+    bool sweep_node(ASTNode* node, Liveness& live) {
+        switch (node->kind) {
+        case NodeKind::Let:
+            if (node->operands.empty()) return true;
+            if (live.dead(node->operands[0].value)) return false;
+            live.kill(node->operands[0].value);
+            return true;
+        case NodeKind::Return:
+            if (live.dead(node->value)) return false;
+            live.kill(node->value);
+            return true;
+        case NodeKind::Add:
+            if (node->operands.size() < 3) return true;
+            if (live.dead(node->operands[2].value)) return false;
+            live.kill(node->operands[2].value);
+            live.use(node->operands[0].value);
+            live.use(node->operands[1].value);
+            return true;
+        case NodeKind::Malloc:
+            if (node->operands.size() >= 2) live.kill(node->operands[1].value);
+            return true;
+        case NodeKind::Print: case NodeKind::Free:
+            if (!node->operands.empty()) live.use(node->operands[0].value);
+            return true;
+        case NodeKind::Block:
+            node->children = sweep_block(node->children, live);
+            return true;
+        case NodeKind::For:
+            // A FOR left with no body only stores its counters
+            if (node->children.empty() && node->condition && live.rest_dead &&
+                live.marked.lower_bound(node->value) == live.marked.upper_bound(node->condition->value))
+                return false;
+            // fall through
+        case NodeKind::While: case NodeKind::Repeat: case NodeKind::Preheader: case NodeKind::Switch: {
+            if (node->kind == NodeKind::Switch) {
+                for (ASTNode* arm : node->children) {
+                    Liveness after = live;
+                    arm->children = sweep_block(arm->children, after);
+                }
+            } else {
+                sweep_nested(node);
+            }
+            set<int64_t> reads;
+            collect_reads(node, reads);
+            for (int64_t name : reads) live.use(name);
+            return true;
+        }
+        default:
+            return true;
+        }
+    }
+};
+
+// Inliner, run before the optimizer: a CALL to a small or @optimizeInline function that
+// cannot reach itself gets a copy of the body as its children, with the callee's
+// variables renamed to private names in the caller's frame. The copy only runs while
+// the name still resolves to that function; after a redefinition the CALL is a call.
+size_t inline_budget = 16;    // Largest body, in nodes, inlined without an annotation
+bool inline_report = false;   // Print each decision to stderr
+
+void configure_inliner_from_env() {
+    const char* budget = getenv("CONTOUR_INLINE_BUDGET");
+    if (budget) inline_budget = strtoul(budget, nullptr, 10);
+    const char* report = getenv("CONTOUR_INLINE_REPORT");
+    if (report && string(report) != "0") inline_report = true;
+}
+
+// Names handed out for inlined variables, well away from anything a program writes
+map<pair<const ASTNode*, int64_t>, int64_t> inline_variable_names;
+int64_t next_inline_variable = INT64_MIN / 2;
+
+class ASTInliner {
+public:
+    ASTInliner(ASTArena& arena, string_view site) : arena(arena), site(site) {}
+
+    void inline_calls(ASTNode* node) {
+        switch (node->kind) {
+        case NodeKind::Func:
+            return;   // Definitions are handled when they are parsed
+        case NodeKind::Call:
+            if (node->inlined_from == nullptr) try_inline(node);
+            return;
+        default:
+            for (ASTNode* child : node->children) inline_calls(child);
+            return;
+        }
+    }
+
+private:
+    ASTArena& arena;
+    string_view site;
+
+    template <typename Visit>
+    static void for_each_call(ASTNode* node, Visit visit) {
+        if (node->kind == NodeKind::Call) visit(node);
+        for (ASTNode* child : node->children) for_each_call(child, visit);
+    }
+
+    static size_t count_nodes(ASTNode* node) {
+        size_t count = 1;
+        for (ASTNode* child : node->children) count += count_nodes(child);
+        return count;
+    }
+
+    // FOR writes a range of names that cannot be renamed one by one
+    static bool has_for(ASTNode* node) {
+        if (node->kind == NodeKind::For) return true;
+        for (ASTNode* child : node->children) {
+            if (has_for(child)) return true;
+        }
+        return false;
+    }
+
+    static bool reaches(ASTNode* from, ASTNode* target, set<ASTNode*>& visited) {
+        bool found = false;
+        for (ASTNode* child : from->children) {
+            for_each_call(child, [&](ASTNode* call) {
+                ASTNode* callee = resolve_callee(call);
+                if (found || !callee) return;
+                if (callee == target) found = true;
+                else if (visited.insert(callee).second) found = reaches(callee, target, visited);
+            });
+        }
+        return found;
+    }
+
+    // Every variable name field of a node, nested bodies included
+    template <typename Visit>
+    static void for_each_name(ASTNode* node, Visit visit) {
+        switch (node->kind) {
+        case NodeKind::Let: case NodeKind::Print: case NodeKind::Free:
+            if (!node->operands.empty()) visit(node->operands[0].value);
+            break;
+        case NodeKind::Add:
+            for (Operand& operand : node->operands) visit(operand.value);
+            break;
+        case NodeKind::Malloc:
+            if (node->operands.size() >= 2) visit(node->operands[1].value);
+            break;
+        case NodeKind::Return: case NodeKind::Switch:
+            visit(node->value);
+            break;
+        case NodeKind::While:
+            if (node->condition) visit(node->condition->value);
+            break;
+        default:
+            break;
+        }
+        for (ASTNode* child : node->children) for_each_name(child, visit);
+    }
+
+    void report(string_view callee, const string& outcome) {
+        if (inline_report) cerr << "inline: " << callee << " into " << site << ": " << outcome << endl;
+    }
+
+    void try_inline(ASTNode* call) {
+        ASTNode* func = resolve_callee(call);
+        if (!func) return;
+        size_t size = 0;
+        for (ASTNode* child : func->children) size += count_nodes(child);
+        if (!func->inline_hint && size > inline_budget) {
+            report(call->function_name, "skipped, " + to_string(size) + " nodes over budget");
+            return;
+        }
+        for (ASTNode* child : func->children) {
+            if (has_for(child)) return report(call->function_name, "skipped, body has FOR");
+        }
+        set<ASTNode*> visited;
+        if (reaches(func, func, visited)) return report(call->function_name, "skipped, recursive");
+
+        // Parameters take the argument values and every other variable starts at zero,
+        // as in the fresh frame a real call pushes
+        auto rename = [&](int64_t& name) {
+            auto key = make_pair(static_cast<const ASTNode*>(func), name);
+            auto it = inline_variable_names.find(key);
+            if (it == inline_variable_names.end()) it = inline_variable_names.emplace(key, next_inline_variable++).first;
+            name = it->second;
+        };
+        set<int64_t> locals;
+        for (ASTNode* child : func->children) for_each_name(child, [&](int64_t& name) { locals.insert(name); });
+        for (size_t i = 0; i < func->function_args.size(); ++i) {
+            int64_t param = func->function_args[i];
+            locals.erase(param);
+            int64_t name = param;
+            rename(name);
+            ASTNode* bind = make_node(arena, "LET");
+            bind->operands.push_back(arena, Operand{name, -1});
+            bind->operands.push_back(arena, Operand{i < call->function_args.size() ? call->function_args[i] : 0, -1});
+            call->children.push_back(arena, bind);
+        }
+        for (int64_t local : locals) {
+            int64_t name = local;
+            rename(name);
+            ASTNode* zero = make_node(arena, "LET");
+            zero->operands.push_back(arena, Operand{name, -1});
+            zero->operands.push_back(arena, Operand{0, -1});
+            call->children.push_back(arena, zero);
+        }
+        for (ASTNode* child : func->children) {
+            ASTNode* copy = copy_ast(child, arena);
+            for_each_name(copy, rename);
+            call->children.push_back(arena, copy);
+        }
+        call->inlined_from = func;
+        report(call->function_name, to_string(size) + " nodes" + (func->inline_hint ? ", @optimizeInline" : ""));
+    }
+};
+
+// Loop optimizer, run after the AST optimizer. It hoists stores whose value cannot
+// change between passes out of WHILE and FOR bodies, and turns a FOR whose body never
+// touches the counter variables into a REPEAT: the count stays in the executor's
+// continuation, the counter stores become one bodiless FOR, and the body is unrolled.
+size_t unroll_factor = 4;
+constexpr size_t MAX_UNROLLED_NODES = 64;   // Largest unrolled body, in nodes
+
+void configure_unroll_from_env() {
+    const char* factor = getenv("CONTOUR_UNROLL");
+    if (factor) unroll_factor = max(1UL, strtoul(factor, nullptr, 10));
+}
+
+class ASTLoopOptimizer {
+public:
+    explicit ASTLoopOptimizer(ASTArena& arena) : arena(arena) {}
+
+    // A top-level statement may grow hoisted siblings; they share a Block then
+    ASTNode* optimize_program(ASTNode* root) {
+        NodeList single;
+        single.push_back(arena, root);
+        NodeList optimized = optimize_block(single);
+        if (optimized.size() == 1) return optimized[0];
+        ASTNode* block = make_node(arena, NodeKind::Block, "BLOCK");
+        block->children = optimized;
+        return block;
+    }
+
+    void optimize_function(ASTNode* func) { func->children = optimize_block(func->children); }
+
+private:
+    ASTArena& arena;
+
+    // Names a subtree writes, counting each store; FOR counters as ranges
+    struct Writes {
+        map<int64_t, int> counts;
+        vector<pair<int64_t, int64_t>> ranges;
+
+        int count(int64_t name) const {
+            int total = 0;
+            auto it = counts.find(name);
+            if (it != counts.end()) total = it->second;
+            for (const auto& range : ranges) total += name >= range.first && name <= range.second;
+            return total;
+        }
+    };
+
+    static void collect_writes(ASTNode* node, Writes& writes) {
+        switch (node->kind) {
+        case NodeKind::Let:
+            if (!node->operands.empty()) writes.counts[node->operands[0].value]++;
+            break;
+        case NodeKind::Add:
+            if (node->operands.size() >= 3) writes.counts[node->operands[2].value]++;
+            break;
+        case NodeKind::Malloc:
+            if (node->operands.size() >= 2) writes.counts[node->operands[1].value]++;
+            break;
+        case NodeKind::Return:
+            writes.counts[node->value]++;
+            break;
+        case NodeKind::For:
+            if (node->condition) writes.ranges.push_back({node->value, node->condition->value});
+            break;
+        default:
+            break;
+        }
+        if (node->kind == NodeKind::Func || node->kind == NodeKind::Call) return;
+        for (ASTNode* child : node->children) collect_writes(child, writes);
+    }
+
+    static size_t count_nodes(const NodeList& nodes) {
+        size_t count = 0;
+        for (ASTNode* node : nodes) count += 1 + count_nodes(node->children);
+        return count;
+    }
+
+    // Move invariant LET/ADD statements from the front of body's scope into hoisted.
+    // A statement qualifies when its target has no other store in the loop and is not
+    // read before it in a pass, and its inputs are never written in the loop. Names in
+    // [first, last] are a FOR's counters, stored on every pass.
+    void hoist_invariants(NodeList& body, NodeList& hoisted, int64_t first, int64_t last) {
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            Writes writes;
+            for (ASTNode* node : body) collect_writes(node, writes);
+            if (first <= last) writes.ranges.push_back({first, last});
+            set<int64_t> read_before;
+            for (size_t i = 0; i < body.size(); ++i) {
+                ASTNode* node = body[i];
+                bool invariant = false;
+                if (node->kind == NodeKind::Let && node->operands.size() >= 2) {
+                    int64_t target = node->operands[0].value;
+                    invariant = writes.count(target) == 1 && !read_before.count(target);
+                } else if (node->kind == NodeKind::Add && node->operands.size() >= 3) {
+                    int64_t lhs = node->operands[0].value, rhs = node->operands[1].value, target = node->operands[2].value;
+                    invariant = writes.count(target) == 1 && !read_before.count(target) && target != lhs &&
+                                target != rhs && writes.count(lhs) == 0 && writes.count(rhs) == 0;
+                }
+                if (invariant) {
+                    hoisted.push_back(arena, node);
+                    NodeList rest;
+                    for (size_t j = 0; j < body.size(); ++j) {
+                        if (j != i) rest.push_back(arena, body[j]);
+                    }
+                    body = rest;
+                    changed = true;
+                    break;
+                }
+                collect_reads(node, read_before);
+            }
+        }
+    }
+
+    void append_copies(NodeList& out, const NodeList& body, size_t copies) {
+        for (size_t i = 0; i < copies; ++i) {
+            for (ASTNode* node : body) out.push_back(arena, i == 0 ? node : copy_ast(node, arena));
+        }
+    }
+
+    NodeList optimize_block(const NodeList& nodes) {
+        NodeList out;
+        for (ASTNode* node : nodes) {
+            if (node->kind != NodeKind::Func) {
+                if (node->kind == NodeKind::Call && !node->inlined_from) {
+                    out.push_back(arena, node);
+                    continue;
+                }
+                node->children = optimize_block(node->children);   // Inner loops first
+            }
+            if (node->kind == NodeKind::While && node->condition && !node->children.empty()) {
+                NodeList hoisted;
+                hoist_invariants(node->children, hoisted, 1, 0);
+                if (!hoisted.empty() && node->children[0]->kind == NodeKind::Preheader) {
+                    for (ASTNode* statement : hoisted) node->children[0]->children.push_back(arena, statement);
+                } else if (!hoisted.empty()) {
+                    // Hoisted stores run once, after the entry test: WHILE may not run at all
+                    ASTNode* preheader = make_node(arena, NodeKind::Preheader, "PREHEADER");
+                    preheader->children = hoisted;
+                    NodeList body;
+                    body.push_back(arena, preheader);
+                    for (ASTNode* child : node->children) body.push_back(arena, child);
+                    node->children = body;
+                }
+            } else if (node->kind == NodeKind::For && node->condition && node->condition->value >= node->value &&
+                       !node->children.empty()) {
+                // The range is not empty, so hoisted stores can simply precede the loop
+                int64_t first = node->value, last = node->condition->value;
+                NodeList hoisted;
+                hoist_invariants(node->children, hoisted, first, last);
+                for (ASTNode* statement : hoisted) out.push_back(arena, statement);
+                if (lower_counted_for(node, out)) continue;
+            }
+            out.push_back(arena, node);
+        }
+        return out;
+    }
+
+    // FOR whose body neither reads nor writes a counter name: emit the counter stores on
+    // their own, then the body as a REPEAT unrolled by unroll_factor plus the remainder
+    bool lower_counted_for(ASTNode* node, NodeList& out) {
+        if (node->children.empty()) return false;
+        int64_t first = node->value, last = node->condition->value;
+        set<int64_t> reads;
+        Writes writes;
+        for (ASTNode* child : node->children) {
+            collect_reads(child, reads);
+            collect_writes(child, writes);
+        }
+        if (reads.lower_bound(first) != reads.upper_bound(last)) return false;
+        if (writes.counts.lower_bound(first) != writes.counts.upper_bound(last)) return false;
+        for (const auto& range : writes.ranges) {
+            if (range.first <= last && range.second >= first) return false;
+        }
+        uint64_t trips = static_cast<uint64_t>(last) - static_cast<uint64_t>(first) + 1;
+        if (trips == 0 || trips > static_cast<uint64_t>(INT64_MAX)) return false;
+
+        ASTNode* counters = make_node(arena, "FOR", first);
+        counters->condition = node->condition;
+        out.push_back(arena, counters);
+
+        NodeList body = node->children;
+        size_t body_nodes = count_nodes(body);
+        size_t factor = unroll_factor;
+        if (trips < factor || body_nodes * factor > MAX_UNROLLED_NODES) factor = 1;
+        if (trips <= MAX_UNROLLED_NODES / body_nodes) {
+            append_copies(out, body, static_cast<size_t>(trips));   // Short loop: no loop left
+            return true;
+        }
+        ASTNode* repeat = make_node(arena, NodeKind::Repeat, "REPEAT", static_cast<int64_t>(trips / factor));
+        append_copies(repeat->children, body, factor);
+        out.push_back(arena, repeat);
+        append_copies(out, body, static_cast<size_t>(trips % factor));
+        return true;
+    }
+};
+
+// Single-pass lexer over a source view. Words split on whitespace, and ';' and '{' are
+// tokens of their own; every token is a view into the source, so lexing never allocates.
+class Lexer {
+public:
+    explicit Lexer(string_view source) : source(source) {}
+
+    string_view peek() {
+        if (!peeked) {
+            lookahead = scan();
+            peeked = true;
+        }
+        return lookahead;
+    }
+
+    string_view next() {
+        string_view token = peek();
+        peeked = false;
+        return token;
+    }
+
+    bool at_end() { return peek().empty(); }
+
+    // Consume the next token if the whole of it is an integer
+    bool integer(int64_t& value) {
+        string_view token = peek();
+        const char* first = token.data();
+        const char* last = first + token.size();
+        if (first != last && *first == '+') first++;
+        auto result = from_chars(first, last, value);
+        if (first == last || result.ec != errc() || result.ptr != last) return false;
+        next();
+        return true;
+    }
+
+private:
+    string_view source;
+    size_t position = 0;
+    string_view lookahead;
+    bool peeked = false;
+
+    static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+    static bool is_single(char c) { return c == ';' || c == '{'; }
+
+    string_view scan() {
+        while (position < source.size() && is_space(source[position])) position++;
+        size_t start = position;
+        if (position < source.size() && is_single(source[position])) return source.substr(position++, 1);
+        while (position < source.size() && !is_space(source[position]) && !is_single(source[position])) position++;
+        return source.substr(start, position - start);
+    }
+};
+
+// Recursive-descent parser producing the arena AST. A statement is one command; a block
+// is statements separated by ';' and closed by END:
+//   FUNC name args { body;...;END       WHILE x; body;...;END
+//   FOR start end step statement        SWITCH x CASE k body;...;END; DEFAULT body;...;END; END
+// MATCH is SWITCH with CASE _ for DEFAULT. Tokens a statement leaves unused are skipped.
+class ASTParser {
+public:
+    ASTParser(string_view source, ASTArena& arena) : source(source), lexer(source), arena(arena) {}
+
+    // First problem found, empty when the whole statement parsed
+    const string& error() const { return first_error; }
+
+    ASTNode* statement() {
+        string_view cmd = lexer.next();
+        bool inline_hint = false;
+        if (cmd == "@optimizeInline") {
+            inline_hint = true;
+            cmd = lexer.next();
+        }
+
+        ASTNode* root = make_node(arena, cmd);
+        root->inline_hint = inline_hint;
+
+        switch (root->kind) {
+            case NodeKind::Func:
+                function(root);
+                break;
+            case NodeKind::Call: {
+                root->function_name = arena.intern(lexer.next());  // Function name to call
+                int64_t arg;
+                while (lexer.integer(arg)) root->function_args.push_back(arena, arg);
+                break;
+            }
+            case NodeKind::Switch:
+                lexer.integer(root->value);  // Variable to dispatch on
+                while (true) {
+                    while (lexer.peek() == ";") lexer.next();
+                    if (lexer.peek() != "CASE" && lexer.peek() != "DEFAULT") break;
+                    bool is_default = lexer.next() == "DEFAULT";
+                    int64_t key = 0;
+                    if (!is_default && !lexer.integer(key)) {
+                        is_default = lexer.peek() == "_";
+                        lexer.next();
+                    }
+                    ASTNode* arm = is_default ? make_node(arena, "DEFAULT") : make_node(arena, "CASE", key);
+                    block(arm->children);
+                    root->children.push_back(arena, arm);
+                }
+                if (lexer.peek() == "END") lexer.next();
+                break;
+            case NodeKind::Return:
+                lexer.integer(root->value);
+                break;
+            case NodeKind::While: {
+                int64_t variable = 0;
+                lexer.integer(variable);
+                root->condition = make_node(arena, "CONDITION", variable);
+                block(root->children);
+                break;
+            }
+            case NodeKind::For: {
+                int64_t start = 0, end = 0, increment = 0;
+                lexer.integer(start);
+                lexer.integer(end);
+                lexer.integer(increment);
+                root->value = start;
+                root->children.push_back(arena, statement());  // Loop body
+                root->condition = make_node(arena, "CONDITION", end);  // Store the loop end condition
+                break;
+            }
+            default: {
+                int64_t param;
+                while (lexer.integer(param)) root->operands.push_back(arena, Operand{param, -1});
+                if (root->operands.size() < required_operands(root->kind)) {
+                    size_t needed = required_operands(root->kind);
+                    fail(cmd, string(cmd) + " needs " + to_string(needed) + " operand" + (needed == 1 ? "" : "s") +
+                                  ", got " + to_string(root->operands.size()));
+                }
+                break;
+            }
+        }
+        return root;
+    }
+
+private:
+    string_view source;
+    Lexer lexer;
+    ASTArena& arena;
+    string first_error;
+
+    void fail(string_view token, const string& message) {
+        if (first_error.empty())
+            first_error = "column " + to_string(token.data() - source.data() + 1) + ": " + message;
+    }
+
+    // Statements up to END or the end of the input
+    void block(NodeList& out) {
+        while (!lexer.at_end()) {
+            string_view token = lexer.peek();
+            if (token == ";") {
+                lexer.next();
+            } else if (token == "END") {
+                lexer.next();
+                return;
+            } else {
+                out.push_back(arena, statement());
+                while (!lexer.at_end() && lexer.peek() != ";" && lexer.peek() != "END") lexer.next();
+            }
+        }
+    }
+
+    void function(ASTNode* root) {
+        string_view name = lexer.next();  // Function name
+        root->function_name = arena.intern(name);
+        while (!lexer.at_end() && lexer.peek() != "{") {
+            int64_t arg;
+            if (lexer.integer(arg)) root->function_args.push_back(arena, arg);  // Collect arguments
+            else lexer.next();
+        }
+        lexer.next();  // '{'
+        block(root->children);
+        if (!first_error.empty()) return;   // A body that did not parse is never defined
+        if (ast_optimizer_enabled) {
+            for (ASTNode* child : root->children) ASTInliner(arena, root->function_name).inline_calls(child);
+            ASTOptimizer(arena).optimize_function(root);
+            ASTLoopOptimizer(arena).optimize_function(root);
+            ASTOptimizer(arena).optimize_function(root);   // Drops counter stores nobody reads
+        }
+        resolve_function_frame(root, arena);
+        function_table[string(name)] = root;  // Store function in table
+        function_table_generation++;   // Invalidate callees cached by CALL nodes
+        arena.holds_functions = true;
+    }
+};
+
+// Parse one top-level program into arena and resolve it against the global frame.
+// A program that does not parse is reported and comes back as nullptr.
+ASTNode* parse_program(string_view source, ASTArena& arena) {
+    ASTParser parser(source, arena);
+    ASTNode* root = parser.statement();
+    if (!parser.error().empty()) {
+        cerr << "Parse error at " << parser.error() << endl;
+        return nullptr;
+    }
+    if (ast_optimizer_enabled) {
+        ASTInliner(arena, "top level").inline_calls(root);
+        ASTOptimizer(arena).optimize_program(root);
+        root = ASTLoopOptimizer(arena).optimize_program(root);
+    }
+    resolve_slots(root, global_layout, arena);
+    resolve_for_counters(root, global_layout, arena);
+    return root;
+}
+
+// Make sure the global frame exists and covers every slot resolved so far
+void ensure_global_frame() {
+    if (call_stack.frame_bases.empty()) call_stack.push_frame(0);
+    if (call_stack.frame_bases.size() == 1 && call_stack.slots.size() < global_layout.size())
+        call_stack.slots.resize(global_layout.size(), 0);
+}
+
+// What the tree walker still has to do: the rest of owner's children, then the
+// action for its kind once they run out. The stack of these lives on the heap, so
+// Contour recursion depth is bounded by max_call_stack_bytes, not the C++ stack.
+struct Continuation {
+    enum Kind : uint8_t { While, For, Repeat, Return, Block };
+    Kind kind;
+    uint32_t next;       // Index of the next child of owner to run
+    ASTNode* owner;      // Loop, block or inlined CALL, or the FUNC whose frame Return pops
+    int64_t counter;     // FOR: current counter value, REPEAT: passes left
+    uint32_t stored = 0; // FOR: counters stored so far
+};
+vector<Continuation> continuations;
+
+size_t call_stack_bytes() {
+    return call_stack.slots.size() * sizeof(int64_t) + call_stack.frame_bases.size() * sizeof(size_t) +
+           continuations.size() * sizeof(Continuation);
+}
+
+// Errors the tree walker can hit. begin_node returns one instead of throwing, so the
+// normal path carries no handlers or context strings; the message and the call trace
+// are only put together in report_execution_error, from the continuation stack.
+enum class ExecStatus : uint8_t { Ok, UndefinedFunction, StackOverflow, MissingOperand };
+
+const size_t MAX_TRACE_FRAMES = 16;
+
+void report_execution_error(ExecStatus status, const ASTNode* node) {
+    cerr << "Error: ";
+    switch (status) {
+    case ExecStatus::UndefinedFunction:
+        cerr << "Undefined function: " << node->function_name;
+        break;
+    case ExecStatus::StackOverflow:
+        cerr << "Stack overflow due to too many recursive calls.";
+        break;
+    case ExecStatus::MissingOperand:
+        cerr << node->command << " needs " << required_operands(node->kind) << " operand"
+             << (required_operands(node->kind) == 1 ? "" : "s") << ", got " << node->operands.size();
+        break;
+    case ExecStatus::Ok:
+        break;
+    }
+    cerr << endl;
+
+    // Innermost first: every Return continuation is a live call, a Block owned by a
+    // CALL is an inlined one
+    size_t frames = 0;
+    for (auto it = continuations.rbegin(); it != continuations.rend(); ++it) {
+        bool inlined = it->kind == Continuation::Block && it->owner->kind == NodeKind::Call;
+        if (it->kind != Continuation::Return && !inlined) continue;
+        if (frames++ < MAX_TRACE_FRAMES) {
+            cerr << "    in " << it->owner->function_name << (inlined ? " (inlined)" : "") << endl;
+        }
+    }
+    if (frames > MAX_TRACE_FRAMES) cerr << "    ... " << frames - MAX_TRACE_FRAMES << " more frames" << endl;
+}
+
+// Start one node: simple commands run now, compound ones push a continuation
+ExecStatus begin_node(ASTNode* root) {
+    switch (root->kind) {
+    case NodeKind::Let:
+        if (root->operands.size() < required_operands(NodeKind::Let)) return ExecStatus::MissingOperand;
+        call_stack[root->operands[0].slot] = root->operands[1].value;
+        break;
+    case NodeKind::Add: {
+        if (root->operands.size() < required_operands(NodeKind::Add)) return ExecStatus::MissingOperand;
+        int64_t result = wrapping_add(call_stack[root->operands[0].slot], call_stack[root->operands[1].slot]);
+        call_stack[root->operands[2].slot] = result;
+        break;
+    }
+    case NodeKind::Call: {
+        ASTNode* func = resolve_callee(root);
+        if (!func) return ExecStatus::UndefinedFunction;
+        if (func == root->inlined_from) {
+            // Still the function that was inlined: run the copy in this frame
+            if (!root->children.empty()) continuations.push_back({Continuation::Block, 0, root, 0});
+            break;
+        }
+
+        // A call that is the last statement of a function body replaces that body's
+        // frame instead of stacking a new one, so self-recursion runs in constant space
+        bool tail = !continuations.empty() && continuations.back().kind == Continuation::Return &&
+                    continuations.back().next == continuations.back().owner->children.size();
+        if (tail) {
+            call_stack.pop_frame();
+            continuations.pop_back();
+        } else if (call_stack_bytes() + func->frame_size * sizeof(int64_t) + sizeof(size_t) +
+                       sizeof(Continuation) > max_call_stack_bytes) {
+            return ExecStatus::StackOverflow;
+        }
+
+        // Create a new stack frame for the function call and bind arguments to parameters
+        call_stack.push_frame(func->frame_size);
+        for (size_t i = 0; i < func->slots.size() && i < root->function_args.size(); ++i) {
+            call_stack[func->slots[i]] = root->function_args[i];
+        }
+        continuations.push_back({Continuation::Return, 0, func, 0});
+        break;
+    }
+    case NodeKind::Return:
+        // Handle return value
+        call_stack[root->slot] = root->value;
+        break;
+    case NodeKind::While:
+        if (call_stack[root->condition->slot] != 0) continuations.push_back({Continuation::While, 0, root, 0});
+        break;
+    case NodeKind::For: {
+        // Execute for loop (start -> end), storing the counter into the variable of that
+        // name before each pass; only the variables in operands are ever read back
+        if (root->value > root->condition->value) break;
+        if (call_stack.frame_bases.size() == 1) cover_for_range(root->value, root->condition->value);
+        if (root->children.empty()) {
+            for (const Operand& counter : root->operands) call_stack[counter.slot] = counter.value;
+            break;
+        }
+        uint32_t stored = 0;
+        if (!root->operands.empty() && root->operands[0].value == root->value)
+            call_stack[root->operands[stored++].slot] = root->value;
+        continuations.push_back({Continuation::For, 0, root, root->value, stored});
+        break;
+    }
+    case NodeKind::Switch: {
+        uint32_t arm = root->switch_table->arm_for(call_stack[root->slot]);
+        if (arm < root->children.size() && !root->children[arm]->children.empty())
+            continuations.push_back({Continuation::Block, 0, root->children[arm], 0});
+        break;
+    }
+    case NodeKind::Repeat:
+        if (root->value > 0 && !root->children.empty())
+            continuations.push_back({Continuation::Repeat, 0, root, root->value});
+        break;
+    case NodeKind::Block: case NodeKind::Preheader:
+        continuations.push_back({Continuation::Block, 0, root, 0});
+        break;
+    case NodeKind::Print:
+        if (root->operands.size() < required_operands(NodeKind::Print)) return ExecStatus::MissingOperand;
+        cout << "Output: " << call_stack[root->operands[0].slot] << endl;
+        break;
+    default:
+        cerr << "Unknown command: " << root->command << endl;
+        break;
+    }
+    return ExecStatus::Ok;
+}
+
+// Run continuations above base until they are all finished
+void resume_continuations(size_t base) {
+    while (continuations.size() > base) {
+        Continuation& k = continuations.back();
+        if (k.next < k.owner->children.size()) {
+            ASTNode* child = k.owner->children[k.next++];
+            ExecStatus status = begin_node(child);
+            if (status != ExecStatus::Ok) report_execution_error(status, child);
+            continue;
+        }
+        switch (k.kind) {
+        case Continuation::While:
+            if (call_stack[k.owner->condition->slot] != 0) {
+                k.next = !k.owner->children.empty() && k.owner->children[0]->kind == NodeKind::Preheader;
+                continue;
+            }
+            break;
+        case Continuation::Repeat:
+            if (--k.counter > 0) {
+                k.next = 0;
+                continue;
+            }
+            break;
+        case Continuation::For:
+            if (k.counter < k.owner->condition->value) {
+                k.counter++;
+                const auto& counters = k.owner->operands;
+                if (k.stored < counters.size() && counters[k.stored].value == k.counter)
+                    call_stack[counters[k.stored++].slot] = k.counter;
+                k.next = 0;
+                continue;
+            }
+            break;
+        case Continuation::Return:
+            call_stack.pop_frame();  // Remove stack frame after function execution
+            break;
+        case Continuation::Block:
+            break;
+        }
+        continuations.pop_back();
+    }
+}
+
+// Execute an AST without recursing on the C++ stack. An error abandons only the node
+// that raised it; execution carries on with the next one.
+void execute_ast(ASTNode* root) {
+    if (!root) return;
+    size_t base = continuations.size();
+    ExecStatus status = begin_node(root);
+    if (status != ExecStatus::Ok) report_execution_error(status, root);
+    resume_continuations(base);
+}
+
+// AST -> bytecode compiler. Lowers a parsed program onto the bytecode VM's instruction
+// stream so the REPL and script paths share one execution engine. Frame variables are
+// mapped to VM memory slots; CALL is inlined with a fresh set of zeroed locals per
+// callee, which rules out recursion. Anything the compiler does not cover makes
+// compile() return false and run_ast() falls back to execute_ast().
+class ASTCompiler {
+public:
+    vector<Instruction> code;
+
+    bool compile(ASTNode* root) {
+        frames.push_back({"ast:", {}});
+        collect_names(root, frames.back().referenced);
+        bool ok = compile_node(root);
+        frames.pop_back();
+        return ok;
+    }
+
+    // Hand back the memory slots compile() claimed, zeroed as they were, after it failed
+    void release_slots() {
+        for (const string& key : claimed) reference_table.erase(key);
+        fill(memory.begin() + first_claimed, memory.begin() + memory_index, 0);
+        memory_index = first_claimed;
+        claimed.clear();
+    }
+
+private:
+    struct Frame {
+        string prefix;                    // reference_table key prefix for this frame's slots
+        set<int64_t> referenced;          // Variable names the frame's code touches
+    };
+
+    vector<Frame> frames;
+    vector<string_view> inline_stack;
+    vector<string> claimed;                 // reference_table keys this compiler added
+    size_t first_claimed = memory_index;    // memory_index before the first of them
+    size_t loop_depth = 0;
+    size_t conditional_depth = 0;   // WHILE and SWITCH bodies being compiled
+
+    // Variable names a frame touches, not descending into calls (they get their own frame)
+    static void collect_names(ASTNode* node, set<int64_t>& names) {
+        if (!node) return;
+        switch (node->kind) {
+        case NodeKind::Let: case NodeKind::Print: case NodeKind::Free:
+            if (!node->operands.empty()) names.insert(node->operands[0].value);
+            return;
+        case NodeKind::Add:
+            for (const Operand& operand : node->operands) names.insert(operand.value);
+            return;
+        case NodeKind::Malloc:
+            if (node->operands.size() > 1) names.insert(node->operands[1].value);
+            return;
+        case NodeKind::Return:
+            names.insert(node->value);
+            return;
+        case NodeKind::Switch:
+            names.insert(node->value);
+            break;
+        case NodeKind::While:
+            if (node->condition) names.insert(node->condition->value);
+            break;
+        case NodeKind::For: case NodeKind::Case: case NodeKind::Default:
+        case NodeKind::Block: case NodeKind::Preheader: case NodeKind::Repeat:
+            break;
+        case NodeKind::Call:
+            if (!node->inlined_from) return;
+            break;   // An inlined body runs in this frame
+        default:
+            return;   // FUNC and CALL bodies run in their own frames
+        }
+        for (ASTNode* child : node->children) collect_names(child, names);
+    }
+
+    bool slot_for_key(const string& key, int32_t& slot) {
+        if (!reference_table.count(key)) {
+            if (memory_index >= memory.size()) return false;
+            claimed.push_back(key);
+        }
+        slot = static_cast<int32_t>(resolve_variable_slot(key));
+        return true;
+    }
+
+    bool slot(int64_t name, int32_t& result) {
+        string key = frames.back().prefix + to_string(name);
+        bool fresh = !reference_table.count(key);
+        if (!slot_for_key(key, result)) return false;
+        if (fresh && frames.size() == 1) memory[result] = initial_global_value(name);
+        return true;
+    }
+
+    bool temp_slot(int index, int32_t& result) {
+        return slot_for_key("ast:tmp" + to_string(index), result);
+    }
+
+    size_t emit(uint8_t opcode, int32_t a = 0, int32_t b = 0, int32_t c = 0) {
+        Instruction instruction = {};
+        instruction.opcode = opcode;
+        instruction.a = a;
+        instruction.b = b;
+        instruction.c = c;
+        code.push_back(instruction);
+        return code.size() - 1;
+    }
+
+    bool emit_let(int32_t target, int64_t value) {
+        emit(0x10, target, intern_constant(value));
+        return true;
+    }
+
+    bool compile_block(const NodeList& nodes) {
+        for (ASTNode* node : nodes) {
+            if (!compile_node(node)) return false;
+        }
+        return true;
+    }
+
+    bool compile_node(ASTNode* root) {
+        if (!root) return true;
+        int32_t a, b, c;
+
+        switch (root->kind) {
+        case NodeKind::Func:
+            return true;   // Registered in function_table by the parser
+        case NodeKind::Let:
+            if (root->operands.size() < 2 || !slot(root->operands[0].value, a)) return false;
+            return emit_let(a, root->operands[1].value);
+        case NodeKind::Add:
+            if (root->operands.size() < 3 || !slot(root->operands[0].value, a) ||
+                !slot(root->operands[1].value, b) || !slot(root->operands[2].value, c)) return false;
+            emit(0x20, a, b, c);
+            return true;
+        case NodeKind::Print:
+            if (root->operands.empty() || !slot(root->operands[0].value, a)) return false;
+            emit(0x40, a);
+            return true;
+        case NodeKind::Return:
+            if (!slot(root->value, a)) return false;
+            return emit_let(a, root->value);
+        case NodeKind::Malloc:
+            if (root->operands.size() < 2 || !slot(root->operands[1].value, c)) return false;
+            emit(0x70, intern_constant(root->operands[0].value), 0, c);
+            return true;
+        case NodeKind::Free:
+            if (root->operands.empty() || !slot(root->operands[0].value, a)) return false;
+            emit(0x71, a);
+            return true;
+        case NodeKind::While: {
+            conditional_depth++;
+            bool ok = compile_while(root);
+            conditional_depth--;
+            return ok;
+        }
+        case NodeKind::Block: case NodeKind::Preheader:
+            return compile_block(root->children);
+        case NodeKind::Repeat:
+            return root->value <= 0 || compile_counted_loop(root->value, root->children);
+        case NodeKind::For:
+            return compile_for(root);
+        case NodeKind::Switch: {
+            conditional_depth++;
+            bool ok = compile_switch(root);
+            conditional_depth--;
+            return ok;
+        }
+        case NodeKind::Call:
+            return compile_call(root);
+        default:
+            return false;
+        }
+    }
+
+    // jmp cond; body: ...; cond: if x -> body
+    bool compile_while(ASTNode* root) {
+        int32_t a;
+        if (!root->condition || !slot(root->condition->value, a)) return false;
+        bool preheader = !root->children.empty() && root->children[0]->kind == NodeKind::Preheader;
+        if (preheader) {
+            // if x -> pre; jmp exit; pre: hoisted; jmp cond; body: ...
+            size_t enter = emit(0x31, a);
+            size_t skip = emit(0x30);
+            code[enter].b = static_cast<int32_t>(code.size());
+            if (!compile_block(root->children[0]->children)) return false;
+            size_t jump = emit(0x30);
+            size_t body = code.size();
+            for (size_t i = 1; i < root->children.size(); ++i) {
+                if (!compile_node(root->children[i])) return false;
+            }
+            code[jump].a = static_cast<int32_t>(code.size());
+            emit(0x31, a, static_cast<int32_t>(body));
+            code[skip].a = static_cast<int32_t>(code.size());
+            return true;
+        }
+        size_t jump = emit(0x30);
+        size_t body = code.size();
+        if (!compile_block(root->children)) return false;
+        code[jump].a = static_cast<int32_t>(code.size());
+        emit(0x31, a, static_cast<int32_t>(body));
+        return true;
+    }
+
+    // FOR start..end stores each counter value into the variable of that name; only the
+    // names in its operands are ever read back. Each pass that stores one is compiled
+    // with its store, and the passes between them become counted loops.
+    bool compile_for(ASTNode* root) {
+        if (!root->condition) return false;
+        int64_t start = root->value, end = root->condition->value;
+        if (end < start) return true;
+        // Top-level ranges are recorded here rather than when the code runs, which is
+        // only right when nothing can skip the loop
+        bool top_level = frames.size() == 1;
+        if ((top_level && conditional_depth) || root->operands.size() > 64) return false;
+
+        int64_t next = start;   // First pass not compiled yet
+        bool done = false;
+        for (const Operand& counter : root->operands) {
+            int32_t target;
+            if (done || counter.value < next || counter.value > end || !slot(counter.value, target)) return false;
+            if (!root->children.empty() && counter.value > next &&
+                !compile_passes(static_cast<uint64_t>(counter.value) - static_cast<uint64_t>(next), root->children))
+                return false;
+            emit_let(target, counter.value);
+            if (!compile_block(root->children)) return false;
+            done = counter.value == end;
+            if (!done) next = counter.value + 1;
+        }
+        if (!done && !root->children.empty() &&
+            !compile_passes(static_cast<uint64_t>(end) - static_cast<uint64_t>(next) + 1, root->children))
+            return false;
+        if (top_level) cover_for_range(start, end);
+        return true;
+    }
+
+    bool compile_passes(uint64_t passes, const NodeList& body) {
+        return passes <= INT32_MAX && compile_counted_loop(static_cast<int64_t>(passes), body);
+    }
+
+    bool compile_counted_loop(int64_t trips, const NodeList& body) {
+        int32_t count;
+        if (loop_depth == MAX_LOOP_DEPTH || trips > INT32_MAX || !temp_slot(0, count)) return false;
+        emit_let(count, trips);
+        size_t begin = emit(0x33, count);
+        loop_depth++;
+        bool ok = compile_block(body);
+        loop_depth--;
+        if (!ok) return false;
+        size_t loop_end = emit(0x34, static_cast<int32_t>(begin));
+        code[begin].b = static_cast<int32_t>(loop_end);
+        return true;
+    }
+
+    // One SWITCH_TABLE or SWITCH_SEARCH picks the arm: the first CASE with a value wins,
+    // DEFAULT (or the end) takes every other value
+    bool compile_switch(ASTNode* root) {
+        int32_t subject;
+        if (!slot(root->value, subject)) return false;
+        size_t dispatch = emit(0x35, subject);
+        map<int64_t, size_t> cases;   // value -> first instruction of its arm
+        size_t default_start = SIZE_MAX;
+        vector<size_t> exits;
+        for (ASTNode* arm : root->children) {
+            bool reachable = arm->kind == NodeKind::Case ? !cases.count(arm->value)
+                                                         : arm->kind == NodeKind::Default && default_start == SIZE_MAX;
+            if (!reachable) continue;
+            if (arm->kind == NodeKind::Case) cases[arm->value] = code.size();
+            else default_start = code.size();
+            if (!compile_block(arm->children)) return false;
+            exits.push_back(emit(0x30));
+        }
+        int64_t end = static_cast<int64_t>(code.size());
+        for (size_t exit : exits) code[exit].a = static_cast<int32_t>(end);
+        int64_t fallback = default_start == SIZE_MAX ? end : static_cast<int64_t>(default_start);
+
+        vector<int64_t> table;
+        bool dense = cases.empty() || switch_values_are_dense(cases.begin()->first, cases.rbegin()->first, cases.size());
+        if (dense) {
+            int64_t min = cases.empty() ? 0 : cases.begin()->first;
+            int64_t count = cases.empty() ? 0 : cases.rbegin()->first - min + 1;
+            table = {min, count, fallback};
+            table.resize(3 + count, fallback);
+            for (const auto& entry : cases) table[3 + (entry.first - min)] = static_cast<int64_t>(entry.second);
+        } else {
+            table = {static_cast<int64_t>(cases.size()), fallback};
+            for (const auto& entry : cases) table.push_back(entry.first);
+            for (const auto& entry : cases) table.push_back(static_cast<int64_t>(entry.second));
+        }
+        code[dispatch].opcode = dense ? 0x35 : 0x36;
+        code[dispatch].b = append_constants(table);
+        return true;
+    }
+
+    bool compile_call(ASTNode* root) {
+        ASTNode* func = resolve_callee(root);
+        if (!func) return false;
+        if (func == root->inlined_from) return compile_block(root->children);
+        if (find(inline_stack.begin(), inline_stack.end(), func->function_name) != inline_stack.end() ||
+            inline_stack.size() >= static_cast<size_t>(max_inline_depth)) return false;
+
+        // Every inlined call starts from a zeroed frame, like the fresh map execute_ast pushes
+        Frame frame{"ast:" + string(func->function_name) + "#" + to_string(inline_stack.size()) + ":", {}};
+        for (ASTNode* child : func->children) collect_names(child, frame.referenced);
+        for (int64_t param : func->function_args) frame.referenced.insert(param);
+        frames.push_back(frame);
+        inline_stack.push_back(func->function_name);
+
+        bool ok = true;
+        for (int64_t name : frames.back().referenced) {
+            int32_t local;
+            if (!slot(name, local)) { ok = false; break; }
+            int64_t value = 0;
+            for (size_t i = 0; i < func->function_args.size() && i < root->function_args.size(); ++i) {
+                if (func->function_args[i] == name) value = root->function_args[i];
+            }
+            emit_let(local, value);
+        }
+        ok = ok && compile_block(func->children);
+
+        inline_stack.pop_back();
+        frames.pop_back();
+        return ok;
+    }
+};
+
+// Top-level variables live in VM memory slots keyed "ast:<name>"; the tree walker
+// works on the global frame, so copy them across around a fallback run
+void copy_globals_between_vm_and_frame(bool to_frame) {
+    for (const auto& entry : global_layout.slots) {
+        string key = "ast:" + to_string(entry.first);
+        if (to_frame) {
+            auto it = reference_table.find(key);
+            call_stack.slots[entry.second] =
+                it != reference_table.end() ? memory[it->second] : initial_global_value(entry.first);
+        } else if (reference_table.count(key) || memory_index < memory.size()) {
+            memory[resolve_variable_slot(key)] = call_stack.slots[entry.second];
+        }
+    }
+}
+
+// CONTOUR_POOL_REPORT=1 prints the constant pool and VM slot counts after every line
+bool pool_report = false;
+
+void configure_pool_report_from_env() {
+    const char* report = getenv("CONTOUR_POOL_REPORT");
+    if (report && string(report) != "0") pool_report = true;
+}
+
+// Run a parsed program on the shared bytecode engine, or walk the tree when the
+// compiler cannot lower it. The constants and switch tables a line adds are only read
+// by its own code, so the pool goes back to its watermark once the line is done, and
+// a compile that falls back also returns the slots it claimed.
+void run_ast(ASTNode* root) {
+    if (!root) return;   // Already reported by parse_program
+    const size_t constants = constant_pool.size();
+    ASTCompiler compiler;
+    if (compiler.compile(root)) {
+        binary_program = move(compiler.code);
+        bind_program_view();
+        program_counter = 0;
+        print_label = "Output: ";
+        execute_binary_program();
+    } else {
+        compiler.release_slots();
+        ensure_global_frame();
+        copy_globals_between_vm_and_frame(true);
+        execute_ast(root);
+        copy_globals_between_vm_and_frame(false);
+    }
+    truncate_constants(constants);
+    if (pool_report) cerr << "pool: " << constant_pool.size() << " constants, " << memory_index << " slots" << endl;
+}
+
+// Session snapshots: function table, VM memory, frames and heap in one file that is
+// restored with a single mmap. Every node reachable from function_table is copied
+// into an object image with its pointer fields zeroed; fixup records say where each
+// pointer goes, so restoring only writes base + offset into the mapped pages.
+const char SNAPSHOT_MAGIC[4] = {'C', 'T', 'S', 'N'};
+const uint32_t SNAPSHOT_VERSION = 2;
+
+struct SnapshotSection {
+    uint64_t offset;   // From the start of the file
+    uint64_t count;    // Elements, or bytes for the object image
+};
+
+// Nodes are stored in host layout, so a snapshot only restores on a matching build
+struct SnapshotHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;   // 0x01020304 as written by the saving host
+    uint32_t node_size;    // sizeof(ASTNode)
+    uint64_t checksum;     // hash_bytes of everything after the header
+    uint64_t memory_index;
+    int64_t next_inline_variable;
+    SnapshotSection objects, pointer_fixups, string_fixups, functions, memory, references,
+        layout, frame_slots, frame_bases, global_memory, heap, for_ranges;
+};
+
+struct SnapshotPointerFixup {
+    uint64_t field;    // Object image offset of a pointer
+    uint64_t target;   // Object image offset it points to
+};
+
+struct SnapshotStringFixup {
+    uint64_t field;    // Object image offset of a string_view
+    uint64_t target;
+    uint64_t length;
+};
+
+// function_table entry (value: node offset) or reference_table entry (value: slot)
+struct SnapshotName {
+    uint64_t text;
+    uint64_t length;
+    uint64_t value;
+};
+
+struct SnapshotLayoutEntry {
+    int64_t name;
+    int64_t slot;
+};
+
+struct SnapshotRange {
+    int64_t first;
+    int64_t last;
+};
+
+struct SnapshotHeapBlock {
+    int64_t address;   // Where the block lived in the saving process
+    uint64_t size;
+    uint64_t bytes;    // Object image offset of its contents
+    int64_t location;  // Memory slot holding its address, or -1
+};
+
+class SnapshotWriter {
+public:
+    vector<char> objects;
+    vector<SnapshotPointerFixup> pointers;
+    vector<SnapshotStringFixup> strings;
+
+    // Zeroed room in the object image
+    uint64_t reserve(size_t size, size_t align) {
+        size_t offset = (objects.size() + align - 1) & ~(align - 1);
+        objects.resize(offset + size, 0);
+        return offset;
+    }
+
+    uint64_t place(const void* data, size_t size, size_t align) {
+        uint64_t offset = reserve(size, align);
+        if (size) memcpy(&objects[offset], data, size);
+        return offset;
+    }
+
+    uint64_t text(string_view value) {
+        auto it = texts.find(string(value));
+        if (it != texts.end()) return it->second;
+        uint64_t offset = place(value.data(), value.size(), 1);
+        texts.emplace(string(value), offset);
+        return offset;
+    }
+
+    // Copy a node and everything it reaches; a node shared by several parents (a
+    // function an inlined call was copied from, say) is stored once
+    uint64_t node(const ASTNode* source) {
+        auto it = nodes.find(source);
+        if (it != nodes.end()) return it->second;
+        uint64_t offset = place(source, sizeof(ASTNode), alignof(ASTNode));
+        nodes.emplace(source, offset);
+        pending.push_back(source);
+        while (!pending.empty()) {
+            const ASTNode* next = pending.back();
+            pending.pop_back();
+            fill(next, nodes[next]);
+        }
+        return offset;
+    }
 
-using namespace std;
+private:
+    unordered_map<string, uint64_t> texts;
+    unordered_map<const void*, uint64_t> nodes;
+    vector<const ASTNode*> pending;
 
-// Opcode Lookup Table (updated with new opcodes for loop structures)
-unordered_map<string, uint8_t> opcode_lookup = {
-    {"LET", 0x10}, {"ADD", 0x20}, {"SUBTRACT", 0x21}, {"MULTIPLY", 0x22}, {"DIVIDE", 0x23},
-    {"MODULO", 0x24}, {"AND", 0x25}, {"OR", 0x26}, {"NOT", 0x27},
-    {"IF", 0x30}, {"ELSE", 0x31}, {"JUMP", 0x32}, {"LOOP", 0x33},
-    {"FUNC", 0x50}, {"CALL", 0x51}, {"RETURN", 0x52},
-    {"BREAK", 0x34}, {"CONTINUE", 0x35}, {"PRINT", 0x40},
-    {"WHILE", 0x60}, {"FOR", 0x61}
+    static uint64_t field(uint64_t at, const void* object, const void* member) {
+        return at + (static_cast<const char*>(member) - static_cast<const char*>(object));
+    }
+
+    void point(uint64_t field, uint64_t target) {
+        memset(&objects[field], 0, sizeof(void*));
+        pointers.push_back({field, target});
+    }
+
+    void view(uint64_t field, string_view value) {
+        string_view empty;
+        memcpy(&objects[field], &empty, sizeof(empty));
+        if (!value.empty()) strings.push_back({field, text(value), value.size()});
+    }
+
+    // Queue a node for copying without recursing, so deep trees cannot overflow
+    void point_to_node(uint64_t field, const ASTNode* target) {
+        memset(&objects[field], 0, sizeof(void*));
+        if (!target) return;
+        auto it = nodes.find(target);
+        if (it == nodes.end()) {
+            it = nodes.emplace(target, place(target, sizeof(ASTNode), alignof(ASTNode))).first;
+            pending.push_back(target);
+        }
+        point(field, it->second);
+    }
+
+    // Image offset of a vector's first element: inside the node copy, or a fresh copy
+    // of its spilled storage
+    template <typename T, uint32_t N>
+    uint64_t elements(uint64_t at, const ASTNode* source, const ArenaVector<T, N>& values) {
+        T* const* spilled = values.spilled_field();
+        if (!spilled) return field(at, source, values.begin());
+        uint64_t storage = reserve(sizeof(T) * values.storage_capacity(), alignof(T));
+        if (!values.empty()) memcpy(&objects[storage], values.begin(), sizeof(T) * values.size());
+        point(field(at, source, spilled), storage);
+        return storage;
+    }
+
+    uint64_t table(const SwitchTable* source) {
+        uint64_t at = place(source, sizeof(SwitchTable), alignof(SwitchTable));
+        memset(&objects[field(at, source, &source->keys)], 0, sizeof(void*));
+        memset(&objects[field(at, source, &source->arms)], 0, sizeof(void*));
+        point(field(at, source, &source->arms), place(source->arms, sizeof(uint32_t) * source->count, alignof(uint32_t)));
+        if (!source->dense)
+            point(field(at, source, &source->keys), place(source->keys, sizeof(int64_t) * source->count, alignof(int64_t)));
+        return at;
+    }
+
+    void fill(const ASTNode* source, uint64_t at) {
+        view(field(at, source, &source->command), source->command);
+        view(field(at, source, &source->function_name), source->function_name);
+        point_to_node(field(at, source, &source->condition), source->condition);
+        point_to_node(field(at, source, &source->inlined_from), source->inlined_from);
+        // The callee cache is rebuilt on first use against the restored table
+        point_to_node(field(at, source, &source->callee), nullptr);
+        memset(&objects[field(at, source, &source->callee_generation)], 0, sizeof(uint32_t));
+        memset(&objects[field(at, source, &source->switch_table)], 0, sizeof(void*));
+        if (source->switch_table) point(field(at, source, &source->switch_table), table(source->switch_table));
+        elements(at, source, source->operands);
+        elements(at, source, source->function_args);
+        elements(at, source, source->slots);
+        uint64_t children = elements(at, source, source->children);
+        for (size_t i = 0; i < source->children.size(); ++i)
+            point_to_node(children + i * sizeof(ASTNode*), source->children[i]);
+    }
 };
 
-// Memory and Stack
-vector<int64_t> global_memory(256, 0);  // Global memory
-stack<unordered_map<string, int64_t>> local_stack;  // Stack for function calls and local variables
+// Restored images stay mapped while function_table points into them
+struct SnapshotImage {
+    char* base = nullptr;
+    size_t length = 0;
+#if !CONTOUR_HAS_MMAP
+    unique_ptr<char[]> buffer;
+#endif
+
+    ~SnapshotImage() {
+#if CONTOUR_HAS_MMAP
+        if (base) munmap(base, length);
+#endif
+    }
+};
+unique_ptr<SnapshotImage> restored_snapshot;
+
+template <typename T>
+SnapshotSection append_section(vector<char>& file, const T* data, size_t count) {
+    size_t offset = (file.size() + 15) & ~size_t(15);
+    file.resize(offset + sizeof(T) * count, 0);
+    if (count) memcpy(&file[offset], data, sizeof(T) * count);
+    return {offset, count};
+}
 
-int max_recursion_depth = 50;  // Set max recursion depth
-int current_recursion_depth = 0;  // Track the recursion depth
+// Checkpoint the session. The file is written beside its destination and renamed
+// into place, so an interrupted save never leaves a torn snapshot behind.
+bool save_snapshot(const string& path, string& problem) {
+    SnapshotWriter writer;
+    vector<SnapshotName> functions;
+    for (const auto& entry : function_table) {
+        uint64_t text = writer.text(entry.first);
+        functions.push_back({text, entry.first.size(), writer.node(entry.second)});
+    }
+    vector<SnapshotName> references;
+    for (const auto& entry : reference_table)
+        references.push_back({writer.text(entry.first), entry.first.size(), entry.second});
+    vector<SnapshotLayoutEntry> layout;
+    for (const auto& entry : global_layout.slots) layout.push_back({entry.first, entry.second});
+    vector<uint64_t> frame_bases(call_stack.frame_bases.begin(), call_stack.frame_bases.end());
+    vector<SnapshotHeapBlock> heap;
+    for (const auto& block : heap_blocks) {
+        uint64_t bytes = writer.place(reinterpret_cast<const void*>(block.first), block.second.size, 16);
+        // Only the slot MALLOC stored the address in counts, and only while it still does
+        int64_t slot = block.second.slot;
+        bool pointed = slot >= 0 && static_cast<size_t>(slot) < memory.size() && memory[slot] == block.first;
+        heap.push_back({block.first, block.second.size, bytes, pointed ? slot : -1});
+    }
+    vector<SnapshotRange> for_ranges;
+    for (const auto& range : covered_for_ranges) for_ranges.push_back({range.first, range.second});
+
+    SnapshotHeader header = {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = 0x01020304;
+    header.node_size = sizeof(ASTNode);
+    header.memory_index = memory_index;
+    header.next_inline_variable = next_inline_variable;
+    vector<char> file(sizeof(header));
+    header.objects = append_section(file, writer.objects.data(), writer.objects.size());
+    header.pointer_fixups = append_section(file, writer.pointers.data(), writer.pointers.size());
+    header.string_fixups = append_section(file, writer.strings.data(), writer.strings.size());
+    header.functions = append_section(file, functions.data(), functions.size());
+    header.memory = append_section(file, memory.data(), memory.size());
+    header.references = append_section(file, references.data(), references.size());
+    header.layout = append_section(file, layout.data(), layout.size());
+    header.frame_slots = append_section(file, call_stack.slots.data(), call_stack.slots.size());
+    header.frame_bases = append_section(file, frame_bases.data(), frame_bases.size());
+    header.global_memory = append_section(file, global_memory.data(), global_memory.size());
+    header.heap = append_section(file, heap.data(), heap.size());
+    header.for_ranges = append_section(file, for_ranges.data(), for_ranges.size());
+    header.checksum = hash_bytes(file.data() + sizeof(header), file.size() - sizeof(header));
+    memcpy(file.data(), &header, sizeof(header));
+
+    string temporary = path + ".tmp";
+    ofstream out(temporary, ios::binary | ios::trunc);
+    out.write(file.data(), static_cast<streamsize>(file.size()));
+    out.close();
+    if (!out || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+        problem = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
 
-// Function Table: Maps function names to their AST representations
-unordered_map<string, struct ASTNode*> function_table;
+// Replace the session with a saved one. Nothing changes unless the whole file checks out.
+bool restore_snapshot(const string& path, string& problem) {
+    auto image = make_unique<SnapshotImage>();
+#if CONTOUR_HAS_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        if (fd >= 0) close(fd);
+        problem = "cannot open " + path;
+        return false;
+    }
+    image->length = static_cast<size_t>(info.st_size);
+    if (image->length >= sizeof(SnapshotHeader)) {
+        // Private and writable: fixups land in copy-on-write pages, never in the file
+        void* base = mmap(nullptr, image->length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (base != MAP_FAILED) image->base = static_cast<char*>(base);
+    }
+    close(fd);
+#else
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in) {
+        problem = "cannot open " + path;
+        return false;
+    }
+    image->length = static_cast<size_t>(in.tellg());
+    image->buffer = make_unique<char[]>(image->length);
+    in.seekg(0);
+    if (in.read(image->buffer.get(), static_cast<streamsize>(image->length))) image->base = image->buffer.get();
+#endif
+    if (!image->base) {
+        problem = path + " is not a snapshot";
+        return false;
+    }
 
-// Error handling utility
-void throw_error(const string& msg) {
-    throw runtime_error("Error: " + msg);
+    SnapshotHeader header;
+    memcpy(&header, image->base, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != SNAPSHOT_VERSION ||
+        header.byte_order != 0x01020304 || header.node_size != sizeof(ASTNode)) {
+        problem = path + " was not written by this build";
+        return false;
+    }
+    auto fits = [&](const SnapshotSection& section, size_t size) {
+        return section.offset % 16 == 0 && section.offset >= sizeof(header) && section.offset <= image->length &&
+               section.count <= (image->length - section.offset) / size;
+    };
+    if (!fits(header.objects, 1) || !fits(header.pointer_fixups, sizeof(SnapshotPointerFixup)) ||
+        !fits(header.string_fixups, sizeof(SnapshotStringFixup)) || !fits(header.functions, sizeof(SnapshotName)) ||
+        !fits(header.memory, sizeof(int64_t)) || !fits(header.references, sizeof(SnapshotName)) ||
+        !fits(header.layout, sizeof(SnapshotLayoutEntry)) || !fits(header.frame_slots, sizeof(int64_t)) ||
+        !fits(header.frame_bases, sizeof(uint64_t)) || !fits(header.global_memory, sizeof(int64_t)) ||
+        !fits(header.heap, sizeof(SnapshotHeapBlock)) || !fits(header.for_ranges, sizeof(SnapshotRange)) ||
+        header.memory_index > header.memory.count ||
+        hash_bytes(image->base + sizeof(header), image->length - sizeof(header)) != header.checksum) {
+        problem = path + " is damaged";
+        return false;
+    }
+
+    char* objects = image->base + header.objects.offset;
+    uint64_t object_bytes = header.objects.count;
+    auto section = [&](const SnapshotSection& part) { return image->base + part.offset; };
+    auto within = [&](uint64_t offset, uint64_t size) { return offset <= object_bytes && size <= object_bytes - offset; };
+    bool valid = true;
+    const auto* pointers = reinterpret_cast<const SnapshotPointerFixup*>(section(header.pointer_fixups));
+    for (uint64_t i = 0; i < header.pointer_fixups.count && valid; ++i) {
+        valid = within(pointers[i].field, sizeof(void*)) && within(pointers[i].target, 0);
+        void* target = objects + pointers[i].target;
+        if (valid) memcpy(objects + pointers[i].field, &target, sizeof(target));
+    }
+    const auto* strings = reinterpret_cast<const SnapshotStringFixup*>(section(header.string_fixups));
+    for (uint64_t i = 0; i < header.string_fixups.count && valid; ++i) {
+        valid = within(strings[i].field, sizeof(string_view)) && strings[i].field % alignof(string_view) == 0 &&
+                within(strings[i].target, strings[i].length);
+        if (valid) new (objects + strings[i].field) string_view(objects + strings[i].target, strings[i].length);
+    }
+    const auto* functions = reinterpret_cast<const SnapshotName*>(section(header.functions));
+    const auto* references = reinterpret_cast<const SnapshotName*>(section(header.references));
+    for (uint64_t i = 0; i < header.functions.count && valid; ++i) {
+        valid = within(functions[i].text, functions[i].length) && within(functions[i].value, sizeof(ASTNode)) &&
+                functions[i].value % alignof(ASTNode) == 0;
+    }
+    for (uint64_t i = 0; i < header.references.count && valid; ++i) {
+        valid = within(references[i].text, references[i].length) && references[i].value < header.memory.count;
+    }
+    const auto* bases = reinterpret_cast<const uint64_t*>(section(header.frame_bases));
+    for (uint64_t i = 0; i < header.frame_bases.count && valid; ++i) {
+        valid = bases[i] <= header.frame_slots.count && (i == 0 || bases[i - 1] <= bases[i]);
+    }
+    const auto* heap = reinterpret_cast<const SnapshotHeapBlock*>(section(header.heap));
+    for (uint64_t i = 0; i < header.heap.count && valid; ++i) {
+        valid = within(heap[i].bytes, heap[i].size) && heap[i].location >= -1 &&
+                heap[i].location < static_cast<int64_t>(min<uint64_t>(header.memory.count, INT64_MAX));
+    }
+    const auto* for_ranges = reinterpret_cast<const SnapshotRange*>(section(header.for_ranges));
+    for (uint64_t i = 0; i < header.for_ranges.count && valid; ++i) {
+        valid = for_ranges[i].first <= for_ranges[i].last && (i == 0 || for_ranges[i - 1].last < for_ranges[i].first);
+    }
+    if (!valid) {
+        problem = path + " is damaged";
+        return false;
+    }
+
+    // Nothing can fail from here on: swap the session in
+    function_table.clear();
+    for (uint64_t i = 0; i < header.functions.count; ++i) {
+        string name(objects + functions[i].text, functions[i].length);
+        function_table[name] = reinterpret_cast<ASTNode*>(objects + functions[i].value);
+    }
+    function_table_generation++;
+    function_arenas.clear();
+    // Inlined names were keyed by nodes of the arenas just dropped; the counter only
+    // moves forward so new names never meet restored ones
+    inline_variable_names.clear();
+    next_inline_variable = max(next_inline_variable, header.next_inline_variable);
+
+    const auto* slots = reinterpret_cast<const int64_t*>(section(header.memory));
+    memory.assign(slots, slots + header.memory.count);
+    memory_index = static_cast<size_t>(header.memory_index);
+    reference_table.clear();
+    for (uint64_t i = 0; i < header.references.count; ++i)
+        reference_table[string(objects + references[i].text, references[i].length)] = references[i].value;
+    const auto* globals = reinterpret_cast<const int64_t*>(section(header.global_memory));
+    global_memory.assign(globals, globals + header.global_memory.count);
+
+    global_layout.slots.clear();
+    const auto* layout = reinterpret_cast<const SnapshotLayoutEntry*>(section(header.layout));
+    for (uint64_t i = 0; i < header.layout.count; ++i)
+        global_layout.slots[layout[i].name] = static_cast<int32_t>(layout[i].slot);
+    const auto* frame_slots = reinterpret_cast<const int64_t*>(section(header.frame_slots));
+    call_stack.slots.assign(frame_slots, frame_slots + header.frame_slots.count);
+    call_stack.frame_bases.assign(bases, bases + header.frame_bases.count);
+    covered_for_ranges.clear();
+    for (uint64_t i = 0; i < header.for_ranges.count; ++i)
+        covered_for_ranges[for_ranges[i].first] = for_ranges[i].last;
+
+    // Blocks get new addresses and the slot recorded as pointing at each follows it.
+    // Frame slots are left alone: between lines only the global frame exists, and the
+    // tree walker reloads it from memory before every run.
+    for (const auto& block : heap_blocks) free(reinterpret_cast<void*>(block.first));
+    heap_blocks.clear();
+    for (uint64_t i = 0; i < header.heap.count; ++i) {
+        int64_t address = vm_malloc(static_cast<int64_t>(heap[i].size), heap[i].location);
+        if (address && heap[i].size) memcpy(reinterpret_cast<void*>(address), objects + heap[i].bytes, heap[i].size);
+        if (heap[i].location >= 0) memory[heap[i].location] = address;
+    }
+
+    restored_snapshot = move(image);
+    return true;
 }
 
-// Check memory bounds
-void check_memory_bounds(size_t index) {
-    if (index >= global_memory.size()) throw_error("Memory access out of bounds.");
+// SNAPSHOT <file> checkpoints the session and RESTORE <file> resumes one; any other
+// line is a program
+bool run_session_command(string_view line) {
+    Lexer lexer(line);
+    string_view command = lexer.next();
+    if (command != "SNAPSHOT" && command != "RESTORE") return false;
+    string path(lexer.next());
+    string problem;
+    bool ok = !path.empty() && (command == "SNAPSHOT" ? save_snapshot(path, problem) : restore_snapshot(path, problem));
+    if (path.empty()) problem = "missing snapshot file name";
+    if (!ok) cerr << "Error: " << problem << endl;
+    return true;
 }
 
-// AST Node class with enhanced function-related fields
-class ASTNode {
+// Binary AST format for shipping trees between processes. A stream is "CTAS" and a
+// version byte, then each tree as node records in preorder, a node's condition
+// subtree before its children:
+//   header   varint kind | flags << 5; the flags say which fields follow
+//   command  string reference
+//   slot, value, operands, function_name, function_args, slots, frame_size,
+//   child count, inlined_from   (each only when flagged)
+// Integers are LEB128 varints, signed ones zigzagged. A string reference is 0, a
+// length and the bytes the first time a string appears in the stream, else 1 + its
+// index in the stream's string table. inlined_from names a FUNC written earlier in
+// the stream by position, or any other function by name. CALL callee caches are not
+// stored and SWITCH tables are rebuilt from the arms.
+const char AST_STREAM_MAGIC[4] = {'C', 'T', 'A', 'S'};
+const uint8_t AST_STREAM_VERSION = 1;
+const uint32_t AST_KIND_BITS = 5;
+static_assert(static_cast<uint32_t>(NodeKind::Repeat) < (1u << AST_KIND_BITS), "node kinds must fit a record header");
+
+// Record header flags: which optional fields follow
+const uint32_t RecordInlineHint = 1 << 0;
+const uint32_t RecordSlot = 1 << 1;
+const uint32_t RecordValue = 1 << 2;
+const uint32_t RecordOperands = 1 << 3;
+const uint32_t RecordFunctionName = 1 << 4;
+const uint32_t RecordFunctionArgs = 1 << 5;
+const uint32_t RecordSlots = 1 << 6;
+const uint32_t RecordFrameSize = 1 << 7;
+const uint32_t RecordCondition = 1 << 8;
+const uint32_t RecordChildren = 1 << 9;
+const uint32_t RecordSwitchTable = 1 << 10;
+const uint32_t RecordInlinedFrom = 1 << 11;
+const uint32_t RecordAllFlags = (1 << 12) - 1;
+
+class ASTEncoder {
 public:
-    string command;
-    int64_t value;               // For constants and loop counters
-    vector<ASTNode*> children;   // Nested commands
-    string function_name;        // For function nodes
-    vector<int64_t> function_args;  // Function arguments
-    ASTNode* condition;          // For conditional expressions in loops and if-else statements
+    explicit ASTEncoder(ostream& out) : out(out) {
+        buffer.append(AST_STREAM_MAGIC, sizeof(AST_STREAM_MAGIC));
+        buffer.push_back(static_cast<char>(AST_STREAM_VERSION));
+    }
 
-    ASTNode(const string& cmd, int64_t val = 0) : command(cmd), value(val), condition(nullptr) {}
-    ~ASTNode() {
-        for (ASTNode* child : children) delete child;
-        if (condition) delete condition;
+    // Append one tree and flush it, so a reader can run it before the next is written
+    void write(const ASTNode* root) {
+        pending.push_back(root);
+        while (!pending.empty()) {
+            const ASTNode* node = pending.back();
+            pending.pop_back();
+            record(node);
+            for (size_t i = node->children.size(); i-- > 0;) pending.push_back(node->children[i]);
+            if (node->condition) pending.push_back(node->condition);
+        }
+        out.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+        out.flush();
+        buffer.clear();
     }
-};
 
-// Parse expressions into AST, including functions and control structures
-ASTNode* parse_expression(stringstream& ss) {
-    string cmd;
-    ss >> cmd;
+private:
+    ostream& out;
+    string buffer;
+    vector<const ASTNode*> pending;
+    unordered_map<string, uint64_t> strings;
+    unordered_map<const ASTNode*, uint64_t> functions;   // FUNC nodes written so far
+
+    void varint(uint64_t value) {
+        for (; value >= 0x80; value >>= 7) buffer.push_back(static_cast<char>(value | 0x80));
+        buffer.push_back(static_cast<char>(value));
+    }
 
-    ASTNode* root = new ASTNode(cmd);
+    void signed_varint(int64_t value) {
+        varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
 
-    if (cmd == "FUNC") {
-        ss >> root->function_name;  // Function name
-        string param;
-        while (ss >> param && param != "{") {
-            root->function_args.push_back(stoi(param));  // Collect arguments
+    void text(string_view value) {
+        auto it = strings.find(string(value));
+        if (it != strings.end()) {
+            varint(it->second + 1);
+            return;
         }
-        string block;
-        while (getline(ss, block, ';')) {
-            if (block == "END") break;  // End function definition
-            stringstream block_stream(block);
-            root->children.push_back(parse_expression(block_stream));
+        strings.emplace(string(value), strings.size());
+        varint(0);
+        varint(value.size());
+        buffer.append(value.data(), value.size());
+    }
+
+    template <typename T, uint32_t N>
+    void values(const ArenaVector<T, N>& list) {
+        varint(list.size());
+        for (T value : list) signed_varint(value);
+    }
+
+    void record(const ASTNode* node) {
+        uint32_t flags = (node->inline_hint ? RecordInlineHint : 0) | (node->slot != -1 ? RecordSlot : 0) |
+                         (node->value != 0 ? RecordValue : 0) | (!node->operands.empty() ? RecordOperands : 0) |
+                         (!node->function_name.empty() ? RecordFunctionName : 0) |
+                         (!node->function_args.empty() ? RecordFunctionArgs : 0) |
+                         (!node->slots.empty() ? RecordSlots : 0) | (node->frame_size ? RecordFrameSize : 0) |
+                         (node->condition ? RecordCondition : 0) | (!node->children.empty() ? RecordChildren : 0) |
+                         (node->switch_table ? RecordSwitchTable : 0) | (node->inlined_from ? RecordInlinedFrom : 0);
+        varint(static_cast<uint64_t>(node->kind) | static_cast<uint64_t>(flags) << AST_KIND_BITS);
+        text(node->command);
+        if (flags & RecordSlot) signed_varint(node->slot);
+        if (flags & RecordValue) signed_varint(node->value);
+        if (flags & RecordOperands) {
+            varint(node->operands.size());
+            for (const Operand& operand : node->operands) {
+                signed_varint(operand.value);
+                signed_varint(operand.slot);
+            }
         }
-        function_table[root->function_name] = root;  // Store function in table
-    } else if (cmd == "CALL") {
-        ss >> root->function_name;  // Function name to call
-        int64_t arg;
-        while (ss >> arg) root->function_args.push_back(arg);  // Collect arguments
-    } else if (cmd == "RETURN") {
-        ss >> root->value;  // Return value
-    } else if (cmd == "WHILE") {
-        // Parse the condition and body for the while loop
-        root->condition = parse_expression(ss);
-        string body;
-        while (getline(ss, body, ';')) {
-            if (body == "END") break;  // End of loop
-            stringstream body_stream(body);
-            root->children.push_back(parse_expression(body_stream));
+        if (flags & RecordFunctionName) text(node->function_name);
+        if (flags & RecordFunctionArgs) values(node->function_args);
+        if (flags & RecordSlots) values(node->slots);
+        if (flags & RecordFrameSize) varint(node->frame_size);
+        if (flags & RecordChildren) varint(node->children.size());
+        if (flags & RecordInlinedFrom) {
+            auto it = functions.find(node->inlined_from);
+            if (it != functions.end()) {
+                varint(it->second + 1);
+            } else {
+                varint(0);
+                text(node->inlined_from->function_name);
+            }
         }
-    } else if (cmd == "FOR") {
-        // Parse the loop parameters (e.g., start, end, increment) and body
-        int64_t start, end, increment;
-        ss >> start >> end >> increment;
-        root->value = start;
-        root->children.push_back(parse_expression(ss));  // Parse loop body
-        root->condition = new ASTNode("CONDITION", end);  // Store the loop end condition
-    } else {
-        int64_t param;
-        while (ss >> param) root->children.push_back(new ASTNode("", param));
+        if (node->kind == NodeKind::Func) functions.emplace(node, functions.size());
     }
-    return root;
-}
+};
 
-// Execute AST recursively with function handling, recursion detection, and stack-based memory
-void execute_ast(ASTNode* root) {
-    if (!root) return;
+// Decodes a binary AST stream as its bytes arrive. Records are decoded one at a time
+// against an explicit stack, so neither deep trees nor partial input need recursion or
+// buffering beyond the record in progress. A finished tree is resolved against the
+// global frame and its FUNCs are registered, as if the tree had just been parsed.
+class ASTDecoder {
+public:
+    explicit ASTDecoder(ASTArena& arena) : arena(arena) {}
+
+    // Queue more of the stream; it is decoded as next() asks for trees
+    void feed(string_view bytes) {
+        consumed += position;
+        buffer.erase(0, position);
+        position = 0;
+        buffer.append(bytes.data(), bytes.size());
+    }
 
-    try {
-        if (root->command == "LET") {
-            local_stack.top()[to_string(root->children[0]->value)] = root->children[1]->value;
-        } else if (root->command == "ADD") {
-            int64_t result = local_stack.top()[to_string(root->children[0]->value)] +
-                             local_stack.top()[to_string(root->children[1]->value)];
-            local_stack.top()[to_string(root->children[2]->value)] = result;
-        } else if (root->command == "CALL") {
-            if (function_table.find(root->function_name) == function_table.end())
-                throw_error("Undefined function: " + root->function_name);
+    // The next complete tree, or nullptr when more bytes are needed or the stream is bad
+    ASTNode* next() {
+        if (failed()) return nullptr;
+        if (!header_read) {
+            if (buffer.size() - position < sizeof(AST_STREAM_MAGIC) + 1) return nullptr;
+            if (memcmp(buffer.data() + position, AST_STREAM_MAGIC, sizeof(AST_STREAM_MAGIC)) != 0 ||
+                static_cast<uint8_t>(buffer[position + sizeof(AST_STREAM_MAGIC)]) != AST_STREAM_VERSION) {
+                problem = "not a binary AST stream";
+                return nullptr;
+            }
+            position += sizeof(AST_STREAM_MAGIC) + 1;
+            header_read = true;
+        }
+        while (true) {
+            size_t start = position;
+            if (!read_record()) {
+                position = start;
+                if (malformed) problem = "malformed record at byte " + to_string(consumed + start);
+                return nullptr;
+            }
+            if (ASTNode* tree = place(commit())) return tree;
+        }
+    }
 
-            // Recursion depth check
-            if (current_recursion_depth >= max_recursion_depth)
-                throw_error("Stack overflow due to too many recursive calls.");
+    bool failed() const { return !problem.empty(); }
+    const string& error() const { return problem; }
 
-            // Increase recursion depth
-            current_recursion_depth++;
+    // Between trees with nothing left over, where a stream may end
+    bool at_boundary() const { return stack.empty() && position == buffer.size(); }
 
-            // Create a new stack frame for the function call
-            unordered_map<string, int64_t> new_frame;
-            ASTNode* func = function_table[root->function_name];
+private:
+    struct Frame {
+        ASTNode* node;
+        bool condition;        // Condition subtree still to come
+        uint64_t remaining;    // Children still to come
+        bool switch_table;
+    };
 
-            // Bind arguments to function parameters
-            for (size_t i = 0; i < func->function_args.size(); ++i) {
-                new_frame[to_string(func->function_args[i])] = root->function_args[i];
-            }
-            local_stack.push(new_frame);
+    // The record being read; nothing is committed until all of it has arrived
+    struct Record {
+        NodeKind kind;
+        uint32_t flags;
+        uint64_t command, function_name;   // String table indices
+        int32_t slot;
+        int64_t value;
+        vector<Operand> operands;
+        vector<int64_t> function_args;
+        vector<int32_t> slots;
+        uint64_t frame_size, children;
+        uint64_t inlined_function;         // 1 + FUNC position, or 0 to go by name
+        uint64_t inlined_name;
+        vector<string_view> fresh;         // Strings first seen in this record
+    };
 
-            // Execute function body
-            for (ASTNode* child : func->children) execute_ast(child);
-            local_stack.pop();  // Remove stack frame after function execution
+    ASTArena& arena;
+    string buffer;
+    size_t position = 0;
+    size_t consumed = 0;   // Stream bytes dropped from the front of buffer
+    bool header_read = false;
+    bool malformed = false;
+    string problem;
+    Record record;
+    vector<string_view> strings;
+    vector<ASTNode*> functions;
+    vector<Frame> stack;
+    vector<uint32_t> frame_sizes;   // Of the FUNCs on the stack, innermost last
+
+    bool varint(uint64_t& value) {
+        value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            if (position == buffer.size()) return false;
+            uint8_t byte = static_cast<uint8_t>(buffer[position++]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return shift < 63 || byte <= 1 || (malformed = true, false);
+        }
+        malformed = true;
+        return false;
+    }
 
-            // Decrease recursion depth
-            current_recursion_depth--;
-        } else if (root->command == "RETURN") {
-            // Handle return value
-            local_stack.top()[to_string(root->value)] = root->value;
-        } else if (root->command == "WHILE") {
-            // Execute while loop until condition is false
-            while (local_stack.top()[to_string(root->condition->value)] != 0) {
-                for (ASTNode* child : root->children) {
-                    execute_ast(child);
-                }
+    bool signed_varint(int64_t& value) {
+        uint64_t raw;
+        if (!varint(raw)) return false;
+        value = static_cast<int64_t>(raw >> 1) ^ -static_cast<int64_t>(raw & 1);
+        return true;
+    }
+
+    bool int32(int32_t& value) {
+        int64_t wide;
+        if (!signed_varint(wide)) return false;
+        if (wide < INT32_MIN || wide > INT32_MAX) return malformed = true, false;
+        value = static_cast<int32_t>(wide);
+        return true;
+    }
+
+    bool text(uint64_t& index) {
+        uint64_t reference, length;
+        if (!varint(reference)) return false;
+        if (reference != 0) {
+            index = reference - 1;
+            if (index >= strings.size() + record.fresh.size()) return malformed = true, false;
+            return true;
+        }
+        if (!varint(length)) return false;
+        if (length > buffer.size() - position) return false;
+        index = strings.size() + record.fresh.size();
+        record.fresh.push_back(string_view(buffer.data() + position, length));
+        position += length;
+        return true;
+    }
+
+    bool count(uint64_t& size) {
+        if (!varint(size)) return false;
+        // Every element takes a byte at least, so a count past the data has to wait
+        return size <= buffer.size() - position;
+    }
+
+    static bool slot_fits(int32_t slot, bool used, int64_t limit) { return slot >= (used ? 0 : -1) && slot < limit; }
+
+    bool read_record() {
+        Record& r = record;
+        r.fresh.clear();
+        r.operands.clear();
+        r.function_args.clear();
+        r.slots.clear();
+        r.slot = -1;
+        r.value = 0;
+        r.function_name = UINT64_MAX;
+        r.frame_size = r.children = r.inlined_function = 0;
+
+        uint64_t header;
+        if (!varint(header)) return false;
+        uint64_t kind = header & ((1u << AST_KIND_BITS) - 1);
+        if (kind > static_cast<uint64_t>(NodeKind::Repeat) || (header >> AST_KIND_BITS) & ~static_cast<uint64_t>(RecordAllFlags))
+            return malformed = true, false;
+        r.kind = static_cast<NodeKind>(kind);
+        r.flags = static_cast<uint32_t>(header >> AST_KIND_BITS);
+        if (!text(r.command)) return false;
+        if ((r.flags & RecordSlot) && !int32(r.slot)) return false;
+        if ((r.flags & RecordValue) && !signed_varint(r.value)) return false;
+        uint64_t size;
+        if (r.flags & RecordOperands) {
+            if (!count(size)) return false;
+            for (uint64_t i = 0; i < size; ++i) {
+                Operand operand;
+                if (!signed_varint(operand.value) || !int32(operand.slot)) return false;
+                r.operands.push_back(operand);
             }
-        } else if (root->command == "FOR") {
-            // Execute for loop (start -> end -> increment)
-            for (int64_t i = root->value; i <= root->condition->value; i++) {
-                local_stack.top()[to_string(i)] = i;  // Set loop counter
-                for (ASTNode* child : root->children) {
-                    execute_ast(child);
-                }
+        }
+        if ((r.flags & RecordFunctionName) && !text(r.function_name)) return false;
+        if (r.flags & RecordFunctionArgs) {
+            if (!count(size)) return false;
+            for (uint64_t i = 0; i < size; ++i) {
+                int64_t arg;
+                if (!signed_varint(arg)) return false;
+                r.function_args.push_back(arg);
             }
-        } else if (root->command == "PRINT") {
-            cout << "Output: " << local_stack.top()[to_string(root->children[0]->value)] << endl;
-        } else {
-            cerr << "Unknown command: " << root->command << endl;
         }
-    } catch (const runtime_error& e) {
-        cerr << e.what() << endl;
+        if (r.flags & RecordSlots) {
+            if (!count(size)) return false;
+            for (uint64_t i = 0; i < size; ++i) {
+                int32_t slot;
+                if (!int32(slot)) return false;
+                r.slots.push_back(slot);
+            }
+        }
+        if ((r.flags & RecordFrameSize) && !varint(r.frame_size)) return false;
+        if (r.frame_size > UINT32_MAX) return malformed = true, false;
+        if ((r.flags & RecordChildren) && !varint(r.children)) return false;
+        // Slots index the enclosing function's frame; top-level ones are resolved again, so
+        // only their sign is checked. -1 is "no slot", allowed only where none is used.
+        int64_t limit = INT32_MAX;
+        if (r.kind == NodeKind::Func) limit = r.frame_size;
+        else if (!frame_sizes.empty()) limit = frame_sizes.back();
+        bool condition = !stack.empty() && stack.back().condition;
+        bool used = r.kind == NodeKind::Return || r.kind == NodeKind::Switch ||
+                    (condition && stack.back().node->kind == NodeKind::While);
+        bool fits = slot_fits(r.slot, used, limit);
+        for (size_t i = 0; i < r.operands.size(); ++i) {
+            used = r.kind == NodeKind::Add || r.kind == NodeKind::For || (i == 0 && required_operands(r.kind) > 0);
+            fits = fits && slot_fits(r.operands[i].slot, used, limit);
+        }
+        for (int32_t slot : r.slots) fits = fits && slot_fits(slot, true, limit);
+        // FOR counters are stored as the passes reach them, so their names must ascend
+        for (size_t i = 0; r.kind == NodeKind::For && i < r.operands.size(); ++i) {
+            int64_t name = r.operands[i].value;
+            fits = fits && (i == 0 ? name >= r.value : name > r.operands[i - 1].value);
+        }
+        if (!fits) return malformed = true, false;
+        if (r.flags & RecordInlinedFrom) {
+            if (!varint(r.inlined_function)) return false;
+            if (r.inlined_function > functions.size()) return malformed = true, false;
+            if (r.inlined_function == 0 && !text(r.inlined_name)) return false;
+        }
+        return true;
+    }
+
+    ASTNode* commit() {
+        Record& r = record;
+        // Known command names map to the static ones nodes built by the parser use
+        for (string_view fresh : r.fresh) {
+            const NodeKindName* known = find_node_kind(fresh);
+            strings.push_back(known ? known->name : arena.intern(fresh));
+        }
+        ASTNode* node = make_node(arena, r.kind, strings[r.command], r.value);
+        node->inline_hint = (r.flags & RecordInlineHint) != 0;
+        node->slot = r.slot;
+        for (const Operand& operand : r.operands) node->operands.push_back(arena, operand);
+        if (r.function_name != UINT64_MAX) node->function_name = strings[r.function_name];
+        for (int64_t arg : r.function_args) node->function_args.push_back(arena, arg);
+        for (int32_t slot : r.slots) node->slots.push_back(arena, slot);
+        node->frame_size = static_cast<uint32_t>(r.frame_size);
+        if (r.flags & RecordInlinedFrom) {
+            if (r.inlined_function) {
+                node->inlined_from = functions[r.inlined_function - 1];
+            } else {
+                auto it = function_table.find(string(strings[r.inlined_name]));
+                node->inlined_from = it != function_table.end() ? it->second : nullptr;
+            }
+        }
+        if (r.kind == NodeKind::Func) functions.push_back(node);
+        return node;
+    }
+
+    // Hang a node under its parent, then finish every node that has all its parts.
+    // Returns the root once its tree is complete.
+    ASTNode* place(ASTNode* node) {
+        if (!stack.empty()) {
+            Frame& parent = stack.back();
+            if (parent.condition) {
+                parent.node->condition = node;
+                parent.condition = false;
+            } else {
+                parent.node->children.push_back(arena, node);
+                parent.remaining--;
+            }
+        }
+        stack.push_back({node, (record.flags & RecordCondition) != 0, record.children,
+                         (record.flags & RecordSwitchTable) != 0});
+        if (node->kind == NodeKind::Func) frame_sizes.push_back(node->frame_size);
+        ASTNode* root = stack.front().node;
+        while (!stack.empty() && !stack.back().condition && stack.back().remaining == 0) {
+            finish(stack.back());
+            stack.pop_back();
+        }
+        if (!stack.empty()) return nullptr;
+        resolve_slots(root, global_layout, arena);
+        resolve_for_counters(root, global_layout, arena);
+        return root;
+    }
+
+    void finish(const Frame& frame) {
+        ASTNode* node = frame.node;
+        // Outside FUNC bodies resolve_slots builds the tables once the tree is done
+        if (frame.switch_table && node->kind == NodeKind::Switch && !frame_sizes.empty())
+            build_switch_table(node, arena);
+        if (node->kind == NodeKind::Func) {
+            frame_sizes.pop_back();
+            function_table[string(node->function_name)] = node;
+            function_table_generation++;
+            arena.holds_functions = true;
+        }
+    }
+};
+
+// Parse a script and write its programs as a binary AST stream ("-" for stdout)
+// instead of running them
+int emit_ast(const char* script, const char* destination) {
+    ifstream in(script);
+    if (!in) {
+        cerr << "Error: Could not open script " << script << endl;
+        return 1;
+    }
+    ofstream file;
+    bool to_stdout = strcmp(destination, "-") == 0;
+    if (!to_stdout) file.open(destination, ios::binary | ios::trunc);
+    ostream& out = to_stdout ? cout : file;
+    ASTEncoder encoder(out);
+    auto arena = make_unique<ASTArena>();
+    string line;
+    bool parsed = true;
+    while (getline(in, line)) {
+        if (line.find_first_not_of(" \t\r") == string::npos) continue;
+        ASTNode* root = parse_program(line, *arena);
+        if (root) encoder.write(root);
+        else parsed = false;
+    }
+    if (arena->holds_functions) function_arenas.push_back(move(arena));
+    if (!out) {
+        cerr << "Error: Could not write " << destination << endl;
+        return 1;
+    }
+    return parsed ? 0 : 1;
+}
+
+// Run a binary AST stream from a file or "-" for stdin, each tree as soon as its
+// last byte has arrived
+int run_ast_stream(const char* source) {
+    auto arena = make_unique<ASTArena>();
+    ASTDecoder decoder(*arena);
+    auto consume = [&](const char* bytes, size_t size) {
+        decoder.feed(string_view(bytes, size));
+        while (ASTNode* tree = decoder.next()) run_ast(tree);
+        return !decoder.failed();
+    };
+    bool from_stdin = strcmp(source, "-") == 0;
+    char chunk[64 * 1024];
+    bool ok = true;
+#if CONTOUR_HAS_MMAP
+    // read() hands over what a pipe has now instead of waiting for a full chunk
+    int fd = from_stdin ? STDIN_FILENO : open(source, O_RDONLY);
+    if (fd < 0) {
+        cerr << "Error: Could not open " << source << endl;
+        return 1;
+    }
+    ssize_t got;
+    while (ok && (got = read(fd, chunk, sizeof(chunk))) > 0) ok = consume(chunk, static_cast<size_t>(got));
+    if (!from_stdin) close(fd);
+#else
+    ifstream file;
+    if (!from_stdin) file.open(source, ios::binary);
+    istream& in = from_stdin ? cin : file;
+    if (!in) {
+        cerr << "Error: Could not open " << source << endl;
+        return 1;
+    }
+    while (ok && in.read(chunk, sizeof(chunk)).gcount() > 0) ok = consume(chunk, static_cast<size_t>(in.gcount()));
+#endif
+    if (arena->holds_functions) function_arenas.push_back(move(arena));
+    if (!ok || !decoder.at_boundary()) {
+        cerr << "Error: " << source << ": " << (ok ? "stream ends inside a tree" : decoder.error()) << endl;
+        return 1;
     }
+    return 0;
 }
 
 // REPL for user interaction
@@ -402,26 +5550,126 @@ void repl() {
         getline(cin, input);
 
         if (input == "exit") break;
+        if (run_session_command(input)) continue;
 
-        stringstream ss(input);
-        ASTNode* ast = parse_expression(ss);
-        execute_ast(ast);
-        delete ast;
+        auto arena = make_unique<ASTArena>();
+        run_ast(parse_program(input, *arena));
+        if (arena->holds_functions) function_arenas.push_back(move(arena));
     }
 }
 
-int main() {
+// Run a script one line at a time, as if typed into the REPL. The file is mapped and
+// every line is parsed in place, so a large script is never copied.
+int run_script(const char* path) {
+#if CONTOUR_HAS_MMAP
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        cerr << "Error: Could not open script " << path << endl;
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    size_t length = static_cast<size_t>(info.st_size);
+    void* base = length ? mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    close(fd);
+    if (base == MAP_FAILED) {
+        cerr << "Error: Could not map script " << path << endl;
+        return 1;
+    }
+    string_view source(static_cast<const char*>(base), length);
+#else
+    ifstream file(path, ios::binary);
+    if (!file) {
+        cerr << "Error: Could not open script " << path << endl;
+        return 1;
+    }
+    string text((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    string_view source(text);
+#endif
+
+    // Nodes hold views of interned text only, so the arena outlives the mapping safely
+    auto arena = make_unique<ASTArena>();
+    while (!source.empty()) {
+        size_t end = source.find('\n');
+        string_view line = source.substr(0, end);
+        source.remove_prefix(end == string_view::npos ? source.size() : end + 1);
+        if (line.find_first_not_of(" \t\r") == string_view::npos || run_session_command(line)) continue;
+        run_ast(parse_program(line, *arena));
+    }
+    if (arena->holds_functions) function_arenas.push_back(move(arena));
+
+#if CONTOUR_HAS_MMAP
+    if (base) munmap(base, length);
+#endif
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    initialize_opcode_lookup();
+    configure_dispatch_from_env();
+    configure_fusion_from_env();
+    configure_jit_from_env();
+    configure_compile_threads_from_env();
+    configure_cache_from_env();
+    configure_call_stack_from_env();
+    configure_ast_optimizer_from_env();
+    configure_inliner_from_env();
+    configure_unroll_from_env();
+    configure_pool_report_from_env();
+
+    // Contour --convert program.txt program.ctrb | Contour --run program.{txt,ctrb,ctr}
+    if (argc == 4 && string(argv[1]) == "--convert") {
+        convert_text_to_ctrb(argv[2], argv[3]);
+        return 0;
+    }
+    // Contour --compile program.ctrb main.ctr [module.ctr ...]
+    if (argc >= 4 && string(argv[1]) == "--compile") {
+        compile_contour_program(vector<string>(argv + 3, argv + argc));
+        write_ctrb_image(argv[2]);
+        return 0;
+    }
+    // Training run: profile dispatch, fuse only the pairs that were hot, save as .ctrb
+    if (argc == 4 && string(argv[1]) == "--fuse-profile") {
+        load_program_file(argv[2]);
+        verify_binary_program();
+        start_dispatch_profile();
+        execute_binary_program();
+        report_opcode_pairs(10);
+        cout << "Fused " << fuse_superinstructions(profiled_fusion_set(1)) << " instructions" << endl;
+        write_ctrb_image(argv[3]);
+        return 0;
+    }
+    if (argc == 3 && string(argv[1]) == "--run") {
+        load_program_file(argv[2]);
+        execute_binary_program();
+        return 0;
+    }
+
+    // contour --restore <snapshot> [script]: resume a checkpointed session
+    if (argc > 2 && string_view(argv[1]) == "--restore") {
+        string problem;
+        if (!restore_snapshot(argv[2], problem)) {
+            cerr << "Error: " << problem << endl;
+            return 1;
+        }
+        if (argc > 3) return run_script(argv[3]);
+        repl();
+        return 0;
+    }
+    // contour --emit-ast <script> <out|->, contour --run-ast <file|->
+    if (argc > 3 && string_view(argv[1]) == "--emit-ast") return emit_ast(argv[2], argv[3]);
+    if (argc > 2 && string_view(argv[1]) == "--run-ast") return run_ast_stream(argv[2]);
+    if (argc > 1) return run_script(argv[1]);
     cout << "Extended Virtual Machine with Functions, Loops, and Stack Overflow Prevention...\n";
 
     // Example hard-coded program with function definitions and loops
     cout << "Executing hard-coded function call test:\n";
-    stringstream sample_code;
-    sample_code << "FUNC factorial 0 { IF 0; RETURN 1; END; CALL factorial 0; MULTIPLY 0 0 0; } ";
-    sample_code << "CALL factorial 5;";  // Call function 'factorial'
+    string sample_code = "FUNC factorial 0 { IF 0; RETURN 1; END; CALL factorial 0; MULTIPLY 0 0 0; } ";
+    sample_code += "CALL factorial 5;";  // Call function 'factorial'
 
-    ASTNode* root = parse_expression(sample_code);
-    execute_ast(root);
-    delete root;
+    auto arena = make_unique<ASTArena>();
+    run_ast(parse_program(sample_code, *arena));
+    if (arena->holds_functions) function_arenas.push_back(move(arena));
 
     // Start REPL
     repl();
@@ -429,6 +5677,9 @@ int main() {
     return 0;
 }
 
+// Earlier drafts of the interpreter, kept for reference. They redefine the globals
+// above and are not part of the build.
+#if 0
 // New opcode entries
 opcode_lookup["MALLOC"] = 0x70;
 opcode_lookup["FREE"] = 0x71;
@@ -754,8 +6005,8 @@ void gc_collect() {
     }
 }
 
-•	Implement more advanced memory management techniques such as generational garbage collection.
-	•	Enhance loop and conditional handling to support a wider range of control structures.
+// •	Implement more advanced memory management techniques such as generational garbage collection.
+// 	•	Enhance loop and conditional handling to support a wider range of control structures.
 
 void execute_switch_case(ASTNode* root) {
     if (root->command != "SWITCH") return;
@@ -1735,3 +6986,4 @@ int main() {
 
     return 0;
 }
+#endif
@@ -0,0 +1,31 @@
+# A script written out with --emit-ast runs the same under --run-ast: FUNCs with
+# parameters, a WHILE condition, SWITCH tables, CALL arguments and calls the optimizer
+# inlined before one of their callees was redefined. That holds when the stream comes
+# through a pipe a few bytes at a time, and a stream that stops inside a tree is refused.
+interpreter=$1
+work=${TMPDIR:-/tmp}/contour-stream-$$
+mkdir "$work" || exit 1
+trap 'rm -rf "$work"' EXIT
+"$interpreter" programs/stream.ctr > "$work/text.out" 2>&1
+"$interpreter" --emit-ast programs/stream.ctr "$work/stream.cta" || exit 1
+size=$(wc -c < "$work/stream.cta")
+
+echo "-- script"
+cat "$work/text.out"
+
+echo "-- stream file"
+"$interpreter" --run-ast "$work/stream.cta" 2>&1 | diff "$work/text.out" - && echo "same output"
+
+echo "-- stream piped in 7-byte pieces"
+{
+    offset=0
+    while [ $offset -lt $size ]; do
+        dd bs=7 count=1 2>/dev/null
+        sleep 0.01
+        offset=$((offset + 7))
+    done
+} < "$work/stream.cta" | "$interpreter" --run-ast - 2>&1 | diff "$work/text.out" - && echo "same output"
+
+echo "-- stream cut off inside its last tree"
+head -c $((size - 3)) "$work/stream.cta" | "$interpreter" --run-ast -
+echo "exit $?"
@@ -0,0 +1,24 @@
+# --run leaves the disk alone unless CONTOUR_CACHE=1 asks for the compiled-program cache,
+# and a cache directory that cannot be created changes nothing about the run
+interpreter=$1
+work=${TMPDIR:-/tmp}/contour-cache-$$
+mkdir "$work" || exit 1
+trap 'rm -rf "$work"' EXIT
+unset CONTOUR_CACHE CONTOUR_CACHE_DIR XDG_CACHE_HOME
+
+echo "-- default"
+HOME=$work/home "$interpreter" --run programs/compare_limits.ctr
+[ -e "$work/home" ] && echo "wrote under HOME"
+
+echo "-- CONTOUR_CACHE=1, cold then warm"
+for run in cold warm; do
+    CONTOUR_CACHE=1 CONTOUR_CACHE_DIR=$work/cache "$interpreter" --run programs/compare_limits.ctr > "$work/$run.out" 2>&1
+done
+cat "$work/cold.out"
+cmp -s "$work/cold.out" "$work/warm.out" && echo "warm run matches"
+ls "$work/cache" | sed 's/^[0-9a-f]*\./<key>./'
+
+echo "-- CONTOUR_CACHE=1, cache directory cannot be created"
+touch "$work/file"
+CONTOUR_CACHE=1 CONTOUR_CACHE_DIR=$work/file/cache "$interpreter" --run programs/compare_limits.ctr
+echo "exit $?"
@@ -0,0 +1,7 @@
+# Comparisons and arithmetic at the ends of the Integer range, in every engine and JIT-compiled
+for dispatch in switch threaded register; do
+    for threshold in 1 1000000; do
+        echo "$dispatch, JIT threshold $threshold"
+        CONTOUR_DISPATCH=$dispatch CONTOUR_JIT_THRESHOLD=$threshold "$1" --run programs/compare_limits.ctr
+    done
+done
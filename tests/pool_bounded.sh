@@ -0,0 +1,12 @@
+# Lines that add fresh constants and switch tables, and lines whose compile falls back to
+# the walker after inlining a call, leave the constant pool and the VM slots as they were
+script=${TMPDIR:-/tmp}/contour-pool-$$.ctr
+trap 'rm -f "$script"' EXIT
+i=0
+while [ $i -lt 300 ]; do
+    echo "FUNC f$i 0 { LET 3 $i ; PRINT 3 ; END"
+    echo "LET 1 $((i + 5000)) ; SWITCH 1 CASE $((i + 5000)) ADD 1 1 2;END;CASE 7 PRINT 7;END;END"
+    echo "SWITCH 1 CASE 7 PRINT 7;END;CASE $((i + 5000)) CALL f$i;BOGUS;END;END"
+    i=$((i + 1))
+done > "$script"
+CONTOUR_INLINE_BUDGET=0 CONTOUR_POOL_REPORT=1 "$1" "$script" 2>&1 | grep '^pool:' | uniq -c
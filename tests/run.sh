@@ -0,0 +1,30 @@
+#!/bin/sh
+# Run every test through the interpreter and compare what it prints, stdout and stderr
+# together, with the .expected file next to it: *.ctr as scripts, *.cta as binary AST
+# streams through --run-ast, and *.sh as shell scripts given the interpreter path for
+# runs that take more than one invocation. Source programs they use live in programs/.
+#
+#   g++ -std=c++17 -O2 -pthread Interpreter.cpp -o contour && tests/run.sh ./contour
+interpreter=${1:-./contour}
+case $interpreter in
+    /*) ;;
+    *) interpreter=$(pwd)/$interpreter ;;
+esac
+cd "$(dirname "$0")" || exit 1
+failed=0
+for test in *.ctr *.cta *.sh; do
+    [ -e "$test" ] && [ "$test" != run.sh ] || continue
+    case $test in
+        *.cta) set -- "$interpreter" --run-ast "$test" ;;
+        *.sh) set -- sh "$test" "$interpreter" ;;
+        *) set -- "$interpreter" "$test" ;;
+    esac
+    if "$@" 2>&1 | diff -u "${test%.*}.expected" - >/dev/null; then
+        echo "ok   $test"
+    else
+        echo "FAIL $test"
+        "$@" 2>&1 | diff -u "${test%.*}.expected" -
+        failed=1
+    fi
+done
+exit $failed
@@ -0,0 +1,59 @@
+# A session saved with SNAPSHOT carries on under --restore with its functions, globals and
+# heap blocks, and a snapshot file that was cut short or altered is refused
+interpreter=$1
+work=${TMPDIR:-/tmp}/contour-snapshot-$$
+mkdir "$work" && cd "$work" || exit 1
+trap 'rm -rf "$work"' EXIT
+
+cat > save.ctr <<'END'
+LET 7 3
+LET 8 1000000
+FUNC sq 1 { ADD 1 1 2;PRINT 2;END
+FUNC sel 1 { SWITCH 1 CASE 3 PRINT 1;END;CASE 1000000 PRINT 1;PRINT 1;END;DEFAULT PRINT 7;END;END;END
+FUNC many 1 2 3 { ADD 1 2 6;ADD 6 3 6;PRINT 6;CALL sq 6;END
+FOR 30 32 1 LET 40 1
+MALLOC 64 20
+SNAPSHOT session.snap
+LET 7 99
+END
+cat > resume.ctr <<'END'
+PRINT 7
+PRINT 8
+PRINT 31
+CALL sq 21
+CALL sel 3
+CALL sel 1000000
+CALL sel 5
+CALL many 1 2 3
+FREE 20
+FUNC sq 1 { PRINT 1;END
+CALL many 4 5 6
+END
+
+echo "-- save"
+"$interpreter" save.ctr
+echo "-- restore"
+"$interpreter" --restore session.snap resume.ctr
+echo "exit $?"
+
+echo "-- shorter than a header"
+head -c 64 session.snap > short.snap
+"$interpreter" --restore short.snap resume.ctr
+echo "exit $?"
+
+echo "-- last bytes cut off"
+size=$(wc -c < session.snap)
+head -c $((size - 8)) session.snap > truncated.snap
+"$interpreter" --restore truncated.snap resume.ctr
+echo "exit $?"
+
+echo "-- one byte changed"
+cp session.snap corrupted.snap
+byte=$(od -An -tu1 -j $((size / 2)) -N1 session.snap)
+printf "\\$(printf %03o $((255 - byte)))" | dd of=corrupted.snap bs=1 seek=$((size / 2)) conv=notrunc 2>/dev/null
+"$interpreter" --restore corrupted.snap resume.ctr
+echo "exit $?"
+
+echo "-- missing"
+"$interpreter" --restore missing.snap resume.ctr
+echo "exit $?"